@@ -63,15 +63,27 @@ case "$1" in
             createjoinsplit)
                 zcash_rpc zcbenchmark createjoinsplit 10
                 ;;
+            createjoinsplitsinglethreaded)
+                zcash_rpc zcbenchmark createjoinsplitsinglethreaded 10
+                ;;
             verifyjoinsplit)
                 zcash_rpc zcbenchmark verifyjoinsplit 1000 "$RAWTXWITHPOUR"
                 ;;
+            verifyjoinsplitoverhead)
+                zcash_rpc zcbenchmark verifyjoinsplitoverhead 1000 "$RAWTXWITHPOUR"
+                ;;
             solveequihash)
                 zcash_rpc zcbenchmark solveequihash 10
                 ;;
             verifyequihash)
                 zcash_rpc zcbenchmark verifyequihash 1000
                 ;;
+            verifyequihashmidstate)
+                zcash_rpc zcbenchmark verifyequihashmidstate 1000
+                ;;
+            verifyequihashbasic)
+                zcash_rpc zcbenchmark verifyequihashbasic 1000
+                ;;
             *)
                 zcashd_stop
                 echo "Bad arguments."
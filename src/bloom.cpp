@@ -11,6 +11,7 @@
 #include "random.h"
 #include "streams.h"
 
+#include <algorithm>
 #include <math.h>
 #include <stdlib.h>
 
@@ -270,3 +271,41 @@ void CRollingBloomFilter::reset()
     b2.reset(nNewTweak);
     nInsertions = 0;
 }
+
+CBlockedBloomFilter::CBlockedBloomFilter(size_t nElements) :
+    // 16 bits per key, with 7 of them set in its block, gives a false
+    // positive rate of about 0.1% at capacity
+    vData(BLOCK_WORDS * std::max<size_t>(1, (nElements * 16 + 511) / 512)),
+    nCapacity(nElements),
+    nInsertions(0),
+    saltBlock(GetRandHash()),
+    saltBits(GetRandHash())
+{
+}
+
+void CBlockedBloomFilter::insert(const uint256& hash)
+{
+    uint64_t* block = &vData[BLOCK_WORDS * (hash.GetHash(saltBlock) % (vData.size() / BLOCK_WORDS))];
+    uint64_t bits = hash.GetHash(saltBits);
+    for (unsigned int i = 0; i < HASH_FUNCS; i++, bits >>= 9) {
+        block[(bits >> 6) & 7] |= (uint64_t)1 << (bits & 63);
+    }
+    nInsertions++;
+}
+
+bool CBlockedBloomFilter::contains(const uint256& hash) const
+{
+    const uint64_t* block = &vData[BLOCK_WORDS * (hash.GetHash(saltBlock) % (vData.size() / BLOCK_WORDS))];
+    uint64_t bits = hash.GetHash(saltBits);
+    for (unsigned int i = 0; i < HASH_FUNCS; i++, bits >>= 9) {
+        if (!(block[(bits >> 6) & 7] & ((uint64_t)1 << (bits & 63))))
+            return false;
+    }
+    return true;
+}
+
+void CBlockedBloomFilter::clear()
+{
+    std::fill(vData.begin(), vData.end(), 0);
+    nInsertions = 0;
+}
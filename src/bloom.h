@@ -6,12 +6,12 @@
 #define BITCOIN_BLOOM_H
 
 #include "serialize.h"
+#include "uint256.h"
 
 #include <vector>
 
 class COutPoint;
 class CTransaction;
-class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -134,5 +134,42 @@ private:
     CBloomFilter b1, b2;
 };
 
+/**
+ * BlockedBloomFilter is a local filter of 256-bit hashes that are already
+ * uniformly distributed, such as serials. Its bits are split into 512-bit
+ * blocks and each key only sets bits in one of them, so a lookup reads a
+ * single block however many hash functions there are.
+ *
+ * Keys cannot be removed; once more than nElements keys are inserted the
+ * false positive rate climbs and the filter should be rebuilt larger.
+ */
+class CBlockedBloomFilter
+{
+public:
+    // Like CRollingBloomFilter, the salts come from GetRandHash() at
+    // creation time.
+    CBlockedBloomFilter(size_t nElements);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+
+    void clear();
+
+    //! Number of keys the filter was sized for
+    size_t capacity() const { return nCapacity; }
+    //! Number of insert() calls since it was created or cleared
+    size_t size() const { return nInsertions; }
+
+private:
+    static const unsigned int BLOCK_WORDS = 8;
+    static const unsigned int HASH_FUNCS = 7;
+
+    std::vector<uint64_t> vData;
+    size_t nCapacity;
+    size_t nInsertions;
+    uint256 saltBlock;
+    uint256 saltBits;
+};
+
 
 #endif // BITCOIN_BLOOM_H
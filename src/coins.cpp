@@ -41,6 +41,10 @@ bool CCoins::Spend(uint32_t nPos)
     return true;
 }
 bool CCoinsView::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const { return false; }
+bool CCoinsView::HaveAnchor(const uint256 &rt) const {
+    ZCIncrementalMerkleTree tree;
+    return GetAnchorAt(rt, tree);
+}
 bool CCoinsView::GetSerial(const uint256 &serial) const { return false; }
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
@@ -57,6 +61,7 @@ bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 
 bool CCoinsViewBacked::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const { return base->GetAnchorAt(rt, tree); }
+bool CCoinsViewBacked::HaveAnchor(const uint256 &rt) const { return base->HaveAnchor(rt); }
 bool CCoinsViewBacked::GetSerial(const uint256 &serial) const { return base->GetSerial(serial); }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
@@ -80,7 +85,12 @@ CCoinsViewCache::~CCoinsViewCache()
 }
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    // Serial entries own no memory of their own, so the map is all of it.
+    // The trees of anchor entries are not counted yet.
+    return memusage::DynamicUsage(cacheCoins) +
+           memusage::DynamicUsage(cacheAnchors) +
+           memusage::DynamicUsage(cacheSerials) +
+           cachedCoinsUsage;
 }
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
@@ -124,6 +134,16 @@ bool CCoinsViewCache::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tr
     return true;
 }
 
+bool CCoinsViewCache::HaveAnchor(const uint256 &rt) const {
+    CAnchorsMap::const_iterator it = cacheAnchors.find(rt);
+    if (it != cacheAnchors.end()) {
+        return it->second.entered;
+    }
+
+    // Not cached, since there is no tree to cache
+    return base->HaveAnchor(rt);
+}
+
 bool CCoinsViewCache::GetSerial(const uint256 &serial) const {
     CSerialsMap::iterator it = cacheSerials.find(serial);
     if (it != cacheSerials.end())
@@ -135,8 +155,6 @@ bool CCoinsViewCache::GetSerial(const uint256 &serial) const {
 
     cacheSerials.insert(std::make_pair(serial, entry));
 
-    // TODO: cache usage
-
     return tmp;
 }
 
@@ -331,8 +349,6 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     CSerialsCacheEntry& entry = cacheSerials[child_it->first];
                     entry.entered = true;
                     entry.flags = CSerialsCacheEntry::DIRTY;
-
-                    // TODO: cache usage
                 }
             } else {
                 if (parent_it->second.entered != child_it->second.entered) {
@@ -403,6 +419,13 @@ bool CCoinsViewCache::HavePourRequirements(const CTransaction& tx) const
         auto it = intermediates.find(pour.anchor);
         if (it != intermediates.end()) {
             tree = it->second;
+        } else if (&pour == &tx.vpour.back()) {
+            // No pour can anchor to the last one's commitments, so its
+            // anchor only has to exist.
+            if (!HaveAnchor(pour.anchor)) {
+                return false;
+            }
+            continue;
         } else if (!GetAnchorAt(pour.anchor, tree)) {
             return false;
         }
@@ -467,3 +490,193 @@ CCoinsModifier::~CCoinsModifier()
         cache.cachedCoinsUsage += memusage::DynamicUsage(it->second.coins);
     }
 }
+
+CCoinsViewShardedCache::CCoinsViewShardedCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn) { }
+
+bool CCoinsViewShardedCache::GetCoins(const uint256 &txid, CCoins &coins) const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(txid);
+    {
+        LOCK(shard.cs);
+        CCoinsMap::iterator it = shard.cacheCoins.find(txid);
+        if (it != shard.cacheCoins.end()) {
+            shard.cachedUsage -= memusage::DynamicUsage(it->second.coins);
+            coins.swap(it->second.coins);
+            shard.cacheCoins.erase(it);
+            return true;
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewShardedCache::HaveCoins(const uint256 &txid) const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(txid);
+    {
+        LOCK(shard.cs);
+        CCoinsMap::const_iterator it = shard.cacheCoins.find(txid);
+        if (it != shard.cacheCoins.end()) {
+            // As in CCoinsViewCache::HaveCoins
+            return !it->second.coins.vout.empty();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+bool CCoinsViewShardedCache::GetSerial(const uint256 &serial) const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(serial);
+    {
+        LOCK(shard.cs);
+        CSerialsMap::iterator it = shard.cacheSerials.find(serial);
+        if (it != shard.cacheSerials.end()) {
+            bool entered = it->second.entered;
+            shard.cacheSerials.erase(it);
+            return entered;
+        }
+    }
+    return base->GetSerial(serial);
+}
+
+bool CCoinsViewShardedCache::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(rt);
+    {
+        LOCK(shard.cs);
+        CAnchorsMap::iterator it = shard.cacheAnchors.find(rt);
+        if (it != shard.cacheAnchors.end()) {
+            bool entered = it->second.entered;
+            if (entered) {
+                shard.cachedUsage -= it->second.tree.DynamicMemoryUsage();
+                tree = it->second.tree;
+            }
+            shard.cacheAnchors.erase(it);
+            return entered;
+        }
+    }
+    return base->GetAnchorAt(rt, tree);
+}
+
+bool CCoinsViewShardedCache::HaveAnchor(const uint256 &rt) const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(rt);
+    {
+        // Kept, as the tree may be asked for next
+        LOCK(shard.cs);
+        CAnchorsMap::const_iterator it = shard.cacheAnchors.find(rt);
+        if (it != shard.cacheAnchors.end())
+            return it->second.entered;
+    }
+    return base->HaveAnchor(rt);
+}
+
+void CCoinsViewShardedCache::PrefetchCoins(const uint256 &txid) {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(txid);
+    {
+        LOCK(shard.cs);
+        if (shard.cacheCoins.count(txid))
+            return;
+    }
+
+    CCoins tmp;
+    if (!base->GetCoins(txid, tmp))
+        return;
+
+    LOCK(shard.cs);
+    std::pair<CCoinsMap::iterator, bool> ret = shard.cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (ret.second) {
+        // Another thread may have got here first
+        tmp.swap(ret.first->second.coins);
+        shard.cachedUsage += memusage::DynamicUsage(ret.first->second.coins);
+    }
+}
+
+void CCoinsViewShardedCache::PrefetchSerial(const uint256 &serial) {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(serial);
+    {
+        LOCK(shard.cs);
+        if (shard.cacheSerials.count(serial))
+            return;
+    }
+
+    CSerialsCacheEntry entry;
+    entry.entered = base->GetSerial(serial);
+
+    LOCK(shard.cs);
+    shard.cacheSerials.insert(std::make_pair(serial, entry));
+}
+
+void CCoinsViewShardedCache::PrefetchAnchor(const uint256 &rt) {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    Shard& shard = GetShard(rt);
+    {
+        LOCK(shard.cs);
+        if (shard.cacheAnchors.count(rt))
+            return;
+    }
+
+    CAnchorsCacheEntry entry;
+    entry.entered = base->GetAnchorAt(rt, entry.tree);
+
+    LOCK(shard.cs);
+    if (shard.cacheAnchors.insert(std::make_pair(rt, entry)).second && entry.entered)
+        shard.cachedUsage += entry.tree.DynamicMemoryUsage();
+}
+
+uint256 CCoinsViewShardedCache::GetBestBlock() const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    return base->GetBestBlock();
+}
+
+uint256 CCoinsViewShardedCache::GetBestAnchor() const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    return base->GetBestAnchor();
+}
+
+bool CCoinsViewShardedCache::GetStats(CCoinsStats &stats) const {
+    boost::shared_lock<boost::shared_mutex> lock(csBase);
+    return base->GetStats(stats);
+}
+
+bool CCoinsViewShardedCache::BatchWrite(CCoinsMap &mapCoins,
+                                        const uint256 &hashBlock,
+                                        const uint256 &hashAnchor,
+                                        CAnchorsMap &mapAnchors,
+                                        CSerialsMap &mapSerials) {
+    boost::unique_lock<boost::shared_mutex> lock(csBase);
+    // Cleared even if the write fails, since the view below may then be
+    // left in any state
+    bool fOk = base->BatchWrite(mapCoins, hashBlock, hashAnchor, mapAnchors, mapSerials);
+    ClearShards();
+    return fOk;
+}
+
+void CCoinsViewShardedCache::Clear() {
+    boost::unique_lock<boost::shared_mutex> lock(csBase);
+    ClearShards();
+}
+
+void CCoinsViewShardedCache::ClearShards() {
+    for (unsigned int i = 0; i < SHARDS; i++) {
+        LOCK(shards[i].cs);
+        // Swapped out, since clear() would keep the buckets allocated
+        CCoinsMap().swap(shards[i].cacheCoins);
+        CSerialsMap().swap(shards[i].cacheSerials);
+        CAnchorsMap().swap(shards[i].cacheAnchors);
+        shards[i].cachedUsage = 0;
+    }
+}
+
+size_t CCoinsViewShardedCache::DynamicMemoryUsage() const {
+    size_t nUsage = 0;
+    for (unsigned int i = 0; i < SHARDS; i++) {
+        LOCK(shards[i].cs);
+        nUsage += memusage::DynamicUsage(shards[i].cacheCoins) +
+                  memusage::DynamicUsage(shards[i].cacheSerials) +
+                  memusage::DynamicUsage(shards[i].cacheAnchors) +
+                  shards[i].cachedUsage;
+    }
+    return nUsage;
+}
@@ -9,12 +9,14 @@
 #include "compressor.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "sync.h"
 #include "uint256.h"
 
 #include <assert.h>
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include "zcash/IncrementalMerkleTree.hpp"
 
@@ -346,6 +348,9 @@ public:
     //! Retrieve the tree at a particular anchored root in the chain
     virtual bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
 
+    //! Just check whether a root is anchored in the chain, without the tree
+    virtual bool HaveAnchor(const uint256 &rt) const;
+
     //! Determine whether a serial is spent or not
     virtual bool GetSerial(const uint256 &serial) const;
 
@@ -387,6 +392,7 @@ protected:
 public:
     CCoinsViewBacked(CCoinsView *viewIn);
     bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
+    bool HaveAnchor(const uint256 &rt) const;
     bool GetSerial(const uint256 &serial) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
@@ -451,6 +457,7 @@ public:
 
     // Standard CCoinsView methods
     bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
+    bool HaveAnchor(const uint256 &rt) const;
     bool GetSerial(const uint256 &serial) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
@@ -535,4 +542,78 @@ private:
     CCoinsViewCache(const CCoinsViewCache &);
 };
 
+/**
+ * A cache in front of a view that allows concurrent reads, such as
+ * CCoinsViewDB, which is filled ahead of time by the Prefetch methods from
+ * many threads at once. Entries are spread over shards by a salted hash of
+ * their key, each shard with its own lock, so lookups of different keys
+ * seldom wait on each other, and the view below is read without any shard
+ * locked.
+ *
+ * The standard CCoinsView methods are meant for a CCoinsViewCache on top:
+ * an entry it gets is handed over and erased here, so that it is not held
+ * in memory twice. Whatever is not cached is read from the view below
+ * without being cached.
+ *
+ * Writes are not cached: BatchWrite passes them on to the view below and
+ * then empties the cache, so the cache never holds stale entries. Serials
+ * and anchors are prefetched whether or not they were found; coins only
+ * when they were.
+ */
+class CCoinsViewShardedCache : public CCoinsViewBacked
+{
+public:
+    static const unsigned int SHARDS = 16;
+
+private:
+    struct Shard
+    {
+        mutable CCriticalSection cs;
+        CCoinsMap cacheCoins;
+        CSerialsMap cacheSerials;
+        CAnchorsMap cacheAnchors;
+        //! Dynamic memory usage of the CCoins objects and trees in the maps
+        size_t cachedUsage;
+
+        Shard() : cachedUsage(0) {}
+    };
+
+    CCoinsKeyHasher hasher;
+    mutable Shard shards[SHARDS];
+    //! Held shared while reading, and exclusively while writing, the view below
+    mutable boost::shared_mutex csBase;
+
+    Shard& GetShard(const uint256 &key) const { return shards[hasher(key) % SHARDS]; }
+    void ClearShards();
+
+public:
+    CCoinsViewShardedCache(CCoinsView *baseIn);
+
+    // Standard CCoinsView methods, all of which may be called concurrently
+    bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
+    bool HaveAnchor(const uint256 &rt) const;
+    bool GetSerial(const uint256 &serial) const;
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    uint256 GetBestAnchor() const;
+    bool BatchWrite(CCoinsMap &mapCoins,
+                    const uint256 &hashBlock,
+                    const uint256 &hashAnchor,
+                    CAnchorsMap &mapAnchors,
+                    CSerialsMap &mapSerials);
+    bool GetStats(CCoinsStats &stats) const;
+
+    //! Read an entry from the view below into the cache, unless it is there
+    void PrefetchCoins(const uint256 &txid);
+    void PrefetchSerial(const uint256 &serial);
+    void PrefetchAnchor(const uint256 &rt);
+
+    //! Drop every entry
+    void Clear();
+
+    //! Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+};
+
 #endif // BITCOIN_COINS_H
@@ -16,10 +16,24 @@
 #include "util.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <stdexcept>
 
 #include <boost/optional.hpp>
+#include <boost/thread.hpp>
+
+// The AVX2 path reads the fields of libsodium's BLAKE2b state, which are
+// laid out in the headers of library version 9 (the 1.0.8 in depends)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(SODIUM_LIBRARY_VERSION_MAJOR) && SODIUM_LIBRARY_VERSION_MAJOR == 9
+#define EH_AVX2_BLAKE2B
+#include <immintrin.h>
+#endif
 
 template<unsigned int N, unsigned int K>
 int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
@@ -72,13 +86,207 @@ eh_index UntruncateIndex(const eh_trunc t, const eh_index r, const unsigned int
     return (i << (ilen - 8)) | r;
 }
 
+#ifdef EH_AVX2_BLAKE2B
+// Layout HashIndicesAVX2 was written against; any other falls back to the
+// scalar libsodium calls
+static const bool fBlake2bLayout =
+    sizeof(eh_HashState) == 384 &&
+    offsetof(eh_HashState, h) == 0 &&
+    offsetof(eh_HashState, t) == 64 &&
+    offsetof(eh_HashState, f) == 80 &&
+    offsetof(eh_HashState, buf) == 96 &&
+    sizeof(((eh_HashState*)0)->buf) == 256;
+
+static const uint64_t blake2b_IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+// BLAKE2b compression of four independent messages, one per 64-bit lane
+__attribute__((target("avx2")))
+static void Blake2bCompress4(__m256i h[8], const __m256i m[16], uint64_t t0, uint64_t t1, bool fFinal)
+{
+    const __m256i r16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                         2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+    const __m256i r24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                         3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+    __m256i v[16];
+    for (int i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i+8] = _mm256_set1_epi64x(blake2b_IV[i]);
+    }
+    v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x(t0));
+    v[13] = _mm256_xor_si256(v[13], _mm256_set1_epi64x(t1));
+    if (fFinal)
+        v[14] = _mm256_xor_si256(v[14], _mm256_set1_epi64x(-1));
+
+#define EH_G(r, i, a, b, c, d)                                                    \
+    do {                                                                          \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), m[blake2b_sigma[r][2*i]]);   \
+        d = _mm256_shuffle_epi32(_mm256_xor_si256(d, a), _MM_SHUFFLE(2, 3, 0, 1)); \
+        c = _mm256_add_epi64(c, d);                                               \
+        b = _mm256_shuffle_epi8(_mm256_xor_si256(b, c), r24);                     \
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), m[blake2b_sigma[r][2*i+1]]); \
+        d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), r16);                     \
+        c = _mm256_add_epi64(c, d);                                               \
+        b = _mm256_xor_si256(b, c);                                               \
+        b = _mm256_or_si256(_mm256_srli_epi64(b, 63), _mm256_add_epi64(b, b));    \
+    } while (0)
+
+    for (int r = 0; r < 12; r++) {
+        EH_G(r, 0, v[0], v[4], v[ 8], v[12]);
+        EH_G(r, 1, v[1], v[5], v[ 9], v[13]);
+        EH_G(r, 2, v[2], v[6], v[10], v[14]);
+        EH_G(r, 3, v[3], v[7], v[11], v[15]);
+        EH_G(r, 4, v[0], v[5], v[10], v[15]);
+        EH_G(r, 5, v[1], v[6], v[11], v[12]);
+        EH_G(r, 6, v[2], v[7], v[ 8], v[13]);
+        EH_G(r, 7, v[3], v[4], v[ 9], v[14]);
+    }
+#undef EH_G
+
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i+8]));
+}
+
+// Hashes the indices four at a time, continuing from the buffered input of
+// base_state. Returns the number of indices hashed (a multiple of four).
+__attribute__((target("avx2")))
+static size_t HashIndicesAVX2(const eh_HashState& base_state, const eh_index* indices, size_t count, unsigned char* out, size_t hashLen)
+{
+    const size_t BLOCK = 128;
+    size_t buflen = base_state.buflen;
+    size_t msglen = buflen + sizeof(eh_index);
+    size_t nBlocks = (msglen + BLOCK - 1) / BLOCK;
+    uint64_t t0 = base_state.t[0];
+    uint64_t t1 = base_state.t[1];
+
+    // Blocks that end before the index are the same in every lane
+    __m256i h[8];
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm256_set1_epi64x(base_state.h[i]);
+    size_t shared = buflen / BLOCK;
+    for (size_t b = 0; b < shared; b++) {
+        __m256i m[16];
+        for (int w = 0; w < 16; w++) {
+            uint64_t word;
+            memcpy(&word, base_state.buf + b*BLOCK + 8*w, 8);
+            m[w] = _mm256_set1_epi64x(word);
+        }
+        t0 += BLOCK;
+        t1 += (t0 < BLOCK);
+        Blake2bCompress4(h, m, t0, t1, false);
+    }
+
+    unsigned char msg[4][2*BLOCK+sizeof(eh_index)];
+    for (int l = 0; l < 4; l++) {
+        memset(msg[l], 0, sizeof(msg[l]));
+        memcpy(msg[l], base_state.buf, buflen);
+    }
+
+    size_t done = 0;
+    for (; done + 4 <= count; done += 4) {
+        for (int l = 0; l < 4; l++)
+            memcpy(msg[l] + buflen, &indices[done+l], sizeof(eh_index));
+
+        __m256i hl[8];
+        for (int i = 0; i < 8; i++)
+            hl[i] = h[i];
+        uint64_t tl0 = t0;
+        uint64_t tl1 = t1;
+        for (size_t b = shared; b < nBlocks; b++) {
+            __m256i m[16];
+            for (int w = 0; w < 16; w++) {
+                uint64_t words[4];
+                for (int l = 0; l < 4; l++)
+                    memcpy(&words[l], msg[l] + b*BLOCK + 8*w, 8);
+                m[w] = _mm256_setr_epi64x(words[0], words[1], words[2], words[3]);
+            }
+            bool fFinal = (b == nBlocks - 1);
+            uint64_t inc = fFinal ? msglen - b*BLOCK : BLOCK;
+            tl0 += inc;
+            tl1 += (tl0 < inc);
+            Blake2bCompress4(hl, m, tl0, tl1, fFinal);
+        }
+
+        uint64_t words[8][4];
+        for (int i = 0; i < 8; i++)
+            _mm256_storeu_si256((__m256i*) words[i], hl[i]);
+        for (int l = 0; l < 4; l++) {
+            unsigned char digest[64];
+            for (int i = 0; i < 8; i++)
+                memcpy(digest + 8*i, &words[i][l], 8);
+            memcpy(out + (done+l)*hashLen, digest, hashLen);
+        }
+    }
+    return done;
+}
+#endif // EH_AVX2_BLAKE2B
+
+bool EhHashIndicesAVX2Built()
+{
+#ifdef EH_AVX2_BLAKE2B
+    return fBlake2bLayout;
+#else
+    return false;
+#endif
+}
+
+void EhHashIndices(const eh_HashState& base_state, const eh_index* indices, size_t count, unsigned char* out, size_t hashLen)
+{
+    size_t i = 0;
+#ifdef EH_AVX2_BLAKE2B
+    static const bool fAVX2 = fBlake2bLayout && __builtin_cpu_supports("avx2");
+    if (fAVX2 && !base_state.last_node)
+        i = HashIndicesAVX2(base_state, indices, count, out, hashLen);
+#endif
+    for (; i < count; i++) {
+        eh_HashState state;
+        state = base_state;
+        crypto_generichash_blake2b_update(&state, (unsigned char*) &indices[i], sizeof(eh_index));
+        crypto_generichash_blake2b_final(&state, out + i*hashLen, hashLen);
+    }
+}
+
+// Calls f(i, hash) for each index i in [start, end), hashing in batches
+template<typename F>
+void EhGenerateHashes(const eh_HashState& base_state, size_t hashLen, eh_index start, eh_index end, F f)
+{
+    const size_t BATCH = 64;
+    eh_index indices[BATCH];
+    unsigned char hashes[BATCH*64];
+    for (eh_index i = start; i < end; i += BATCH) {
+        size_t count = std::min<eh_index>(BATCH, end - i);
+        for (size_t j = 0; j < count; j++)
+            indices[j] = i + j;
+        EhHashIndices(base_state, indices, count, hashes, hashLen);
+        for (size_t j = 0; j < count; j++)
+            f(indices[j], hashes + j*hashLen);
+    }
+}
+
 template<size_t WIDTH>
-StepRow<WIDTH>::StepRow(unsigned int n, const eh_HashState& base_state, eh_index i)
+StepRow<WIDTH>::StepRow(const unsigned char* hashIn, size_t hInLen)
 {
-    eh_HashState state;
-    state = base_state;
-    crypto_generichash_blake2b_update(&state, (unsigned char*) &i, sizeof(eh_index));
-    crypto_generichash_blake2b_final(&state, hash, n/8);
+    assert(hInLen <= WIDTH);
+    std::copy(hashIn, hashIn+hInLen, hash);
 }
 
 template<size_t WIDTH> template<size_t W>
@@ -89,10 +297,10 @@ StepRow<WIDTH>::StepRow(const StepRow<W>& a)
 }
 
 template<size_t WIDTH>
-FullStepRow<WIDTH>::FullStepRow(unsigned int n, const eh_HashState& base_state, eh_index i) :
-        StepRow<WIDTH> {n, base_state, i}
+FullStepRow<WIDTH>::FullStepRow(const unsigned char* hashIn, size_t hInLen, eh_index i) :
+        StepRow<WIDTH> {hashIn, hInLen}
 {
-    EhIndexToArray(i, hash+(n/8));
+    EhIndexToArray(i, hash+hInLen);
 }
 
 template<size_t WIDTH> template<size_t W>
@@ -141,7 +349,7 @@ std::vector<eh_index> FullStepRow<WIDTH>::GetIndices(size_t len, size_t lenIndic
 }
 
 template<size_t WIDTH>
-bool HasCollision(StepRow<WIDTH>& a, StepRow<WIDTH>& b, int l)
+bool HasCollision(const StepRow<WIDTH>& a, const StepRow<WIDTH>& b, int l)
 {
     // This doesn't need to be constant time.
     for (int j = 0; j < l; j++) {
@@ -152,10 +360,10 @@ bool HasCollision(StepRow<WIDTH>& a, StepRow<WIDTH>& b, int l)
 }
 
 template<size_t WIDTH>
-TruncatedStepRow<WIDTH>::TruncatedStepRow(unsigned int n, const eh_HashState& base_state, eh_index i, unsigned int ilen) :
-        StepRow<WIDTH> {n, base_state, i}
+TruncatedStepRow<WIDTH>::TruncatedStepRow(const unsigned char* hashIn, size_t hInLen, eh_index i, unsigned int ilen) :
+        StepRow<WIDTH> {hashIn, hInLen}
 {
-    hash[n/8] = TruncateIndex(i, ilen);
+    hash[hInLen] = TruncateIndex(i, ilen);
 }
 
 template<size_t WIDTH> template<size_t W>
@@ -190,6 +398,45 @@ eh_trunc* TruncatedStepRow<WIDTH>::GetTruncatedIndices(size_t len, size_t lenInd
     return p;
 }
 
+// Sorts X on the first LEN bytes of each row's hash. This is an LSD radix
+// sort over row positions, so rows are only moved once, when the final
+// permutation is applied in place.
+template<size_t LEN, typename Row>
+void BucketSort(std::vector<Row>& X)
+{
+    std::vector<eh_index> order(X.size());
+    std::vector<eh_index> tmp(X.size());
+    for (eh_index i = 0; i < X.size(); i++)
+        order[i] = i;
+
+    for (size_t b = LEN; b-- > 0; ) {
+        size_t counts[257] = {};
+        for (eh_index i : order)
+            counts[X[i].HashByte(b) + 1]++;
+        for (size_t v = 0; v < 256; v++)
+            counts[v + 1] += counts[v];
+        for (eh_index i : order)
+            tmp[counts[X[i].HashByte(b)]++] = i;
+        order.swap(tmp);
+    }
+
+    // Follow each cycle of the permutation, marking visited positions
+    for (eh_index i = 0; i < X.size(); i++) {
+        if (order[i] == i)
+            continue;
+        Row t {X[i]};
+        eh_index j = i;
+        while (order[j] != i) {
+            eh_index next = order[j];
+            X[j] = X[next];
+            order[j] = j;
+            j = next;
+        }
+        X[j] = t;
+        order[j] = j;
+    }
+}
+
 template<unsigned int N, unsigned int K>
 std::set<std::vector<eh_index>> Equihash<N,K>::BasicSolve(const eh_HashState& base_state)
 {
@@ -201,9 +448,9 @@ std::set<std::vector<eh_index>> Equihash<N,K>::BasicSolve(const eh_HashState& ba
     size_t lenIndices = sizeof(eh_index);
     std::vector<FullStepRow<FullWidth>> X;
     X.reserve(init_size);
-    for (eh_index i = 0; i < init_size; i++) {
-        X.emplace_back(N, base_state, i);
-    }
+    EhGenerateHashes(base_state, N/8, 0, init_size, [&X](eh_index i, const unsigned char* hash) {
+        X.emplace_back(hash, N/8, i);
+    });
 
     // 3) Repeat step 2 until 2n/(k+1) bits remain
     for (int r = 1; r < K && X.size() > 0; r++) {
@@ -333,13 +580,79 @@ void CollideBranches(std::vector<FullStepRow<WIDTH>>& X, const size_t hlen, cons
 }
 
 template<unsigned int N, unsigned int K>
-std::set<std::vector<eh_index>> Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state)
+bool Equihash<N,K>::CullPartialSolution(const eh_HashState& base_state, const eh_trunc* partialSoln, std::set<std::vector<eh_index>>& solns)
+{
+    eh_index soln_size { 1 << K };
+    eh_index recreate_size { UntruncateIndex(1, 0, CollisionBitLength + 1) };
+    size_t hashLen;
+    size_t lenIndices;
+    std::vector<boost::optional<std::vector<FullStepRow<FinalFullWidth>>>> X;
+    X.reserve(K+1);
+
+    // 3) Repeat steps 1 and 2 for each partial index
+    for (eh_index i = 0; i < soln_size; i++) {
+        // 1) Generate first list of possibilities
+        std::vector<FullStepRow<FinalFullWidth>> icv;
+        icv.reserve(recreate_size);
+        eh_index start { UntruncateIndex(partialSoln[i], 0, CollisionBitLength + 1) };
+        EhGenerateHashes(base_state, N/8, start, start + recreate_size,
+                         [&icv](eh_index newIndex, const unsigned char* hash) {
+            icv.emplace_back(hash, N/8, newIndex);
+        });
+        boost::optional<std::vector<FullStepRow<FinalFullWidth>>> ic = icv;
+
+        // 2a) For each pair of lists:
+        hashLen = N/8;
+        lenIndices = sizeof(eh_index);
+        size_t rti = i;
+        for (size_t r = 0; r <= K; r++) {
+            // 2b) Until we are at the top of a subtree:
+            if (r < X.size()) {
+                if (X[r]) {
+                    // 2c) Merge the lists
+                    ic->reserve(ic->size() + X[r]->size());
+                    ic->insert(ic->end(), X[r]->begin(), X[r]->end());
+                    std::sort(ic->begin(), ic->end(), CompareSR(hashLen));
+                    size_t lti = rti-(1<<r);
+                    CollideBranches(*ic, hashLen, lenIndices,
+                                    CollisionByteLength,
+                                    CollisionBitLength + 1,
+                                    partialSoln[lti], partialSoln[rti]);
+
+                    // 2d) Check if this has become an invalid solution
+                    if (ic->size() == 0)
+                        return false;
+
+                    X[r] = boost::none;
+                    hashLen -= CollisionByteLength;
+                    lenIndices *= 2;
+                    rti = lti;
+                } else {
+                    X[r] = *ic;
+                    break;
+                }
+            } else {
+                X.push_back(ic);
+                break;
+            }
+        }
+    }
+
+    // We are at the top of the tree
+    assert(X.size() == K+1);
+    for (FullStepRow<FinalFullWidth> row : *X[K]) {
+        solns.insert(row.GetIndices(hashLen, lenIndices));
+    }
+    return true;
+}
+
+template<unsigned int N, unsigned int K>
+std::set<std::vector<eh_index>> Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state, EhSortMode sortMode)
 {
     eh_index init_size { 1 << (CollisionBitLength + 1) };
 
     // First run the algorithm with truncated indices
 
-    eh_index soln_size { 1 << K };
     // Each element of partialSolns is dynamically allocated in a call to
     // GetTruncatedIndices(), and freed at the end of this function.
     std::vector<eh_trunc*> partialSolns;
@@ -351,16 +664,19 @@ std::set<std::vector<eh_index>> Equihash<N,K>::OptimisedSolve(const eh_HashState
         size_t lenIndices = sizeof(eh_trunc);
         std::vector<TruncatedStepRow<TruncatedWidth>> Xt;
         Xt.reserve(init_size);
-        for (eh_index i = 0; i < init_size; i++) {
-            Xt.emplace_back(N, base_state, i, CollisionBitLength + 1);
-        }
+        EhGenerateHashes(base_state, N/8, 0, init_size, [&Xt](eh_index i, const unsigned char* hash) {
+            Xt.emplace_back(hash, N/8, i, CollisionBitLength + 1);
+        });
 
         // 3) Repeat step 2 until 2n/(k+1) bits remain
         for (int r = 1; r < K && Xt.size() > 0; r++) {
             LogPrint("pow", "Round %d:\n", r);
             // 2a) Sort the list
             LogPrint("pow", "- Sorting list\n");
-            std::sort(Xt.begin(), Xt.end(), CompareSR(hashLen));
+            if (sortMode == EH_SORT_BUCKET)
+                BucketSort<CollisionByteLength>(Xt);
+            else
+                std::sort(Xt.begin(), Xt.end(), CompareSR(hashLen));
 
             LogPrint("pow", "- Finding collisions\n");
             int i = 0;
@@ -414,7 +730,10 @@ std::set<std::vector<eh_index>> Equihash<N,K>::OptimisedSolve(const eh_HashState
         LogPrint("pow", "Final round:\n");
         if (Xt.size() > 1) {
             LogPrint("pow", "- Sorting list\n");
-            std::sort(Xt.begin(), Xt.end(), CompareSR(hashLen));
+            if (sortMode == EH_SORT_BUCKET)
+                BucketSort<2*CollisionByteLength>(Xt);
+            else
+                std::sort(Xt.begin(), Xt.end(), CompareSR(hashLen));
             LogPrint("pow", "- Finding collisions\n");
             for (int i = 0; i < Xt.size() - 1; i++) {
                 TruncatedStepRow<FinalTruncatedWidth> res(Xt[i], Xt[i+1], hashLen, lenIndices, 0);
@@ -432,74 +751,453 @@ std::set<std::vector<eh_index>> Equihash<N,K>::OptimisedSolve(const eh_HashState
     // Now for each solution run the algorithm again to recreate the indices
     LogPrint("pow", "Culling solutions\n");
     std::set<std::vector<eh_index>> solns;
-    eh_index recreate_size { UntruncateIndex(1, 0, CollisionBitLength + 1) };
     int invalidCount = 0;
     for (eh_trunc* partialSoln : partialSolns) {
-        size_t hashLen;
-        size_t lenIndices;
-        std::vector<boost::optional<std::vector<FullStepRow<FinalFullWidth>>>> X;
-        X.reserve(K+1);
-
-        // 3) Repeat steps 1 and 2 for each partial index
-        for (eh_index i = 0; i < soln_size; i++) {
-            // 1) Generate first list of possibilities
-            std::vector<FullStepRow<FinalFullWidth>> icv;
-            icv.reserve(recreate_size);
-            for (eh_index j = 0; j < recreate_size; j++) {
-                eh_index newIndex { UntruncateIndex(partialSoln[i], j, CollisionBitLength + 1) };
-                icv.emplace_back(N, base_state, newIndex);
+        if (!CullPartialSolution(base_state, partialSoln, solns))
+            invalidCount++;
+        delete[] partialSoln;
+    }
+    LogPrint("pow", "- Number of invalid solutions found: %d\n", invalidCount);
+
+    return solns;
+}
+
+// Threads that run the loops of one solve, so that they are created once
+// rather than for every loop. The calling thread takes part in each loop.
+class EhWorkerPool
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    boost::thread_group threads;
+    std::function<void(size_t)> job;
+    size_t count;
+    std::atomic<size_t> next;
+    //! Bumped for every loop, so that each worker joins it once
+    uint64_t nJob;
+    //! Workers that haven't finished the current loop yet
+    unsigned int nBusy;
+    //! First exception thrown by a worker in the current loop
+    std::exception_ptr error;
+    bool fStop;
+
+    void Worker()
+    {
+        uint64_t nSeen = 0;
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (true) {
+            while (!fStop && nJob == nSeen)
+                cond.wait(lock);
+            if (fStop)
+                return;
+            nSeen = nJob;
+            lock.unlock();
+            std::exception_ptr e;
+            try {
+                size_t i;
+                while ((i = next++) < count)
+                    job(i);
+            } catch (...) {
+                // Stop handing out work; ParallelFor rethrows it
+                next = count;
+                e = std::current_exception();
+            }
+            lock.lock();
+            if (e && !error)
+                error = e;
+            if (--nBusy == 0)
+                cond.notify_all();
+        }
+    }
+
+    void WaitForWorkers()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nBusy > 0)
+            cond.wait(lock);
+    }
+
+public:
+    explicit EhWorkerPool(unsigned int nThreads) : count(0), next(0), nJob(0), nBusy(0), fStop(false)
+    {
+        for (unsigned int t = 1; t < nThreads; t++)
+            threads.create_thread([this]() { Worker(); });
+    }
+
+    ~EhWorkerPool()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        threads.join_all();
+    }
+
+    // Runs f(i) for each i in [0, nCount), handing out work items in order
+    template<typename F>
+    void ParallelFor(size_t nCount, F f)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            job = f;
+            count = nCount;
+            next = 0;
+            nBusy = threads.size();
+            error = nullptr;
+            nJob++;
+        }
+        cond.notify_all();
+        try {
+            size_t i;
+            while ((i = next++) < nCount)
+                f(i);
+        } catch (...) {
+            next = nCount;
+            WaitForWorkers();
+            throw;
+        }
+        WaitForWorkers();
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+template<unsigned int N, unsigned int K>
+std::set<std::vector<eh_index>> Equihash<N,K>::ParallelSolve(const eh_HashState& base_state, unsigned int nThreads)
+{
+    // The list is kept split into buckets on the first byte of the
+    // remaining hash. Rows can only collide with rows in the same bucket,
+    // so every bucket is sorted and collided independently. Output rows are
+    // written to a bucket per (source, destination) pair and concatenated
+    // in source order, so the result does not depend on thread scheduling.
+    typedef std::vector<TruncatedStepRow<TruncatedWidth>> RowList;
+    const size_t nBuckets = 256;
+    if (nThreads < 1)
+        nThreads = 1;
+
+    eh_index init_size { 1 << (CollisionBitLength + 1) };
+    EhWorkerPool pool(nThreads);
+
+    // First run the algorithm with truncated indices
+
+    std::vector<eh_trunc*> partialSolns;
+    {
+        std::vector<RowList> Xt(nBuckets);
+        std::vector<std::vector<RowList>> Xc(nBuckets);
+        auto gatherBuckets = [&Xt, &Xc, nBuckets](size_t b) {
+            size_t total = 0;
+            for (size_t src = 0; src < nBuckets; src++)
+                total += Xc[src][b].size();
+            Xt[b].reserve(total);
+            for (size_t src = 0; src < nBuckets; src++) {
+                Xt[b].insert(Xt[b].end(), Xc[src][b].begin(), Xc[src][b].end());
+                RowList().swap(Xc[src][b]);
             }
-            boost::optional<std::vector<FullStepRow<FinalFullWidth>>> ic = icv;
-
-            // 2a) For each pair of lists:
-            hashLen = N/8;
-            lenIndices = sizeof(eh_index);
-            size_t rti = i;
-            for (size_t r = 0; r <= K; r++) {
-                // 2b) Until we are at the top of a subtree:
-                if (r < X.size()) {
-                    if (X[r]) {
-                        // 2c) Merge the lists
-                        ic->reserve(ic->size() + X[r]->size());
-                        ic->insert(ic->end(), X[r]->begin(), X[r]->end());
-                        std::sort(ic->begin(), ic->end(), CompareSR(hashLen));
-                        size_t lti = rti-(1<<r);
-                        CollideBranches(*ic, hashLen, lenIndices,
-                                        CollisionByteLength,
-                                        CollisionBitLength + 1,
-                                        partialSoln[lti], partialSoln[rti]);
-
-                        // 2d) Check if this has become an invalid solution
-                        if (ic->size() == 0)
-                            goto invalidsolution;
-
-                        X[r] = boost::none;
-                        hashLen -= CollisionByteLength;
-                        lenIndices *= 2;
-                        rti = lti;
-                    } else {
-                        X[r] = *ic;
-                        break;
+        };
+
+        // 1) Generate first list, in nBuckets chunks of indices
+        LogPrint("pow", "Generating first list\n");
+        size_t hashLen = N/8;
+        size_t lenIndices = sizeof(eh_trunc);
+        eh_index chunk_size = (init_size + nBuckets - 1) / nBuckets;
+        pool.ParallelFor(nBuckets, [&](size_t c) {
+            Xc[c].resize(nBuckets);
+            eh_index start = std::min(init_size, (eh_index)(c * chunk_size));
+            eh_index end = std::min(init_size, (eh_index)((c + 1) * chunk_size));
+            EhGenerateHashes(base_state, N/8, start, end, [&Xc, c](eh_index i, const unsigned char* hash) {
+                Xc[c][hash[0]].emplace_back(hash, N/8, i, CollisionBitLength + 1);
+            });
+        });
+        pool.ParallelFor(nBuckets, gatherBuckets);
+
+        // 3) Repeat step 2 until 2n/(k+1) bits remain
+        for (int r = 1; r < K; r++) {
+            LogPrint("pow", "Round %d:\n", r);
+            pool.ParallelFor(nBuckets, [&](size_t b) {
+                RowList& X = Xt[b];
+                Xc[b].resize(nBuckets);
+                if (X.size() > 1) {
+                    // 2a) Sort the bucket
+                    std::sort(X.begin(), X.end(), CompareSR(hashLen));
+
+                    int i = 0;
+                    while (i < X.size() - 1) {
+                        // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
+                        int j = 1;
+                        while (i+j < X.size() &&
+                                HasCollision(X[i], X[i+j], CollisionByteLength)) {
+                            j++;
+                        }
+
+                        // 2c) Calculate tuples (X_i ^ X_j, (i, j))
+                        for (int l = 0; l < j - 1; l++) {
+                            for (int m = l + 1; m < j; m++) {
+                                // We truncated, so don't check for distinct indices here
+                                TruncatedStepRow<TruncatedWidth> row(X[i+l], X[i+m], hashLen, lenIndices, CollisionByteLength);
+                                Xc[b][row.HashByte(0)].push_back(row);
+                            }
+                        }
+
+                        i += j;
+                    }
+                }
+                RowList().swap(X);
+            });
+            pool.ParallelFor(nBuckets, gatherBuckets);
+
+            hashLen -= CollisionByteLength;
+            lenIndices *= 2;
+        }
+
+        // k+1) Find a collision on last 2n(k+1) bits
+        LogPrint("pow", "Final round:\n");
+        std::vector<std::vector<eh_trunc*>> bucketSolns(nBuckets);
+        pool.ParallelFor(nBuckets, [&](size_t b) {
+            RowList& X = Xt[b];
+            if (X.size() > 1) {
+                std::sort(X.begin(), X.end(), CompareSR(hashLen));
+                for (int i = 0; i < X.size() - 1; i++) {
+                    TruncatedStepRow<FinalTruncatedWidth> res(X[i], X[i+1], hashLen, lenIndices, 0);
+                    if (res.IsZero(hashLen)) {
+                        bucketSolns[b].push_back(res.GetTruncatedIndices(hashLen, 2*lenIndices));
                     }
-                } else {
-                    X.push_back(ic);
-                    break;
                 }
             }
+            RowList().swap(X);
+        });
+        for (const std::vector<eh_trunc*>& v : bucketSolns)
+            partialSolns.insert(partialSolns.end(), v.begin(), v.end());
+
+    } // Ensure Xt goes out of scope and is destroyed
+
+    LogPrint("pow", "Found %d partial solutions\n", partialSolns.size());
+
+    // Now for each solution run the algorithm again to recreate the indices
+    LogPrint("pow", "Culling solutions\n");
+    std::vector<std::set<std::vector<eh_index>>> partialResults(partialSolns.size());
+    std::vector<char> valid(partialSolns.size());
+    pool.ParallelFor(partialSolns.size(), [&](size_t i) {
+        valid[i] = CullPartialSolution(base_state, partialSolns[i], partialResults[i]);
+        delete[] partialSolns[i];
+    });
+
+    std::set<std::vector<eh_index>> solns;
+    int invalidCount = 0;
+    for (size_t i = 0; i < partialSolns.size(); i++) {
+        if (!valid[i])
+            invalidCount++;
+        solns.insert(partialResults[i].begin(), partialResults[i].end());
+    }
+    LogPrint("pow", "- Number of invalid solutions found: %d\n", invalidCount);
+
+    return solns;
+}
+
+// One round of the index-pointer solver. Entries are kept in buckets on
+// the first byte of their remaining hash, so that byte is not stored.
+// Round 0 entries point at their Equihash index; later entries hold the
+// (bucket, slot) positions of the two entries they were merged from.
+struct EhIndexTable
+{
+    size_t hashLen;
+    size_t nPtrs;
+    std::vector<std::vector<unsigned char>> hashes;
+    std::vector<std::vector<uint32_t>> ptrs;
+
+    EhIndexTable(size_t hlen, size_t np, size_t nBuckets, size_t reserve) :
+            hashLen {hlen}, nPtrs {np}, hashes(nBuckets), ptrs(nBuckets)
+    {
+        for (size_t b = 0; b < nBuckets; b++) {
+            hashes[b].reserve(reserve * hashLen);
+            ptrs[b].reserve(reserve * nPtrs);
         }
+    }
+
+    size_t Size(size_t b) const { return ptrs[b].size() / nPtrs; }
+    const unsigned char* Hash(size_t b, size_t slot) const { return &hashes[b][slot * hashLen]; }
+    const uint32_t* Ptrs(size_t b, size_t slot) const { return &ptrs[b][slot * nPtrs]; }
+};
+
+static const unsigned int EH_SLOT_BITS = 24;
 
-        // We are at the top of the tree
-        assert(X.size() == K+1);
-        for (FullStepRow<FinalFullWidth> row : *X[K]) {
-            solns.insert(row.GetIndices(hashLen, lenIndices));
+inline uint32_t EhPackPtr(size_t bucket, size_t slot)
+{
+    assert(slot < (1u << EH_SLOT_BITS));
+    return (bucket << EH_SLOT_BITS) | slot;
+}
+
+// Fixed-capacity counterpart of EhIndexTable used by BoundedSolve. Its
+// storage is carved out of arenas allocated up front, and each bucket holds
+// at most cap entries; Push() refuses entries beyond that.
+struct EhArenaTable
+{
+    size_t hashLen;
+    size_t nPtrs;
+    size_t cap;
+    unsigned char* hashes;
+    uint32_t* ptrs;
+    std::vector<uint32_t> sizes;
+
+    EhArenaTable(size_t hlen, size_t np, size_t nBuckets, size_t capIn, unsigned char* hashArena, uint32_t* ptrArena) :
+            hashLen {hlen}, nPtrs {np}, cap {capIn}, hashes {hashArena}, ptrs {ptrArena}, sizes(nBuckets, 0) { }
+
+    size_t Size(size_t b) const { return sizes[b]; }
+    const unsigned char* Hash(size_t b, size_t slot) const { return hashes + (b * cap + slot) * hashLen; }
+    const uint32_t* Ptrs(size_t b, size_t slot) const { return ptrs + (b * cap + slot) * nPtrs; }
+
+    bool Push(size_t b, const unsigned char* hash, const uint32_t* p)
+    {
+        if (sizes[b] == cap)
+            return false;
+        size_t slot = sizes[b]++;
+        memcpy(hashes + (b * cap + slot) * hashLen, hash, hashLen);
+        memcpy(ptrs + (b * cap + slot) * nPtrs, p, nPtrs * sizeof(uint32_t));
+        return true;
+    }
+};
+
+// Appends the Equihash indices below an entry of the given round, ordering
+// each pair of subtrees by their first index as FullStepRow does.
+template<typename Table>
+void ExpandIndices(const std::vector<Table>& tables, size_t r, uint32_t ptr, std::vector<eh_index>& out)
+{
+    const uint32_t* p = tables[r].Ptrs(ptr >> EH_SLOT_BITS, ptr & ((1u << EH_SLOT_BITS) - 1));
+    if (r == 0) {
+        out.push_back(p[0]);
+        return;
+    }
+    size_t start = out.size();
+    ExpandIndices(tables, r - 1, p[0], out);
+    size_t mid = out.size();
+    ExpandIndices(tables, r - 1, p[1], out);
+    if (out[mid] < out[start])
+        std::rotate(out.begin() + start, out.begin() + mid, out.end());
+}
+
+// Returns the slots of bucket b sorted on their first keyLen stored bytes
+template<typename Table>
+std::vector<uint32_t> SortedSlots(const Table& table, size_t b, size_t keyLen)
+{
+    std::vector<uint32_t> slots(table.Size(b));
+    for (size_t i = 0; i < slots.size(); i++)
+        slots[i] = i;
+    std::sort(slots.begin(), slots.end(), [&table, b, keyLen](uint32_t x, uint32_t y) {
+        return memcmp(table.Hash(b, x), table.Hash(b, y), keyLen) < 0;
+    });
+    return slots;
+}
+
+template<unsigned int N, unsigned int K>
+std::set<std::vector<eh_index>> Equihash<N,K>::IndexedSolve(const eh_HashState& base_state)
+{
+    const size_t nBuckets = 256;
+    eh_index init_size { 1 << (CollisionBitLength + 1) };
+    // Lists stay close to init_size entries in every round
+    size_t bucket_reserve = (init_size / nBuckets) * 9 / 8;
+
+    // 1) Generate first list
+    LogPrint("pow", "Generating first list\n");
+    size_t hashLen = N/8;
+    std::vector<EhIndexTable> tables;
+    tables.reserve(K);
+    tables.emplace_back(hashLen - 1, 1, nBuckets, bucket_reserve);
+    EhIndexTable& first = tables[0];
+    EhGenerateHashes(base_state, N/8, 0, init_size, [&first](eh_index i, const unsigned char* hash) {
+        first.hashes[hash[0]].insert(first.hashes[hash[0]].end(), hash + 1, hash + N/8);
+        first.ptrs[hash[0]].push_back(i);
+    });
+
+    // 3) Repeat step 2 until 2n/(k+1) bits remain
+    for (int r = 1; r < K; r++) {
+        LogPrint("pow", "Round %d:\n", r);
+        const EhIndexTable& prev = tables[r-1];
+        size_t newLen = hashLen - CollisionByteLength;
+        EhIndexTable next(newLen - 1, 2, nBuckets, bucket_reserve);
+        unsigned char newHash[N/8];
+        for (size_t b = 0; b < nBuckets; b++) {
+            // 2a) Sort the bucket on the rest of the collision bytes
+            std::vector<uint32_t> slots = SortedSlots(prev, b, CollisionByteLength - 1);
+
+            size_t i = 0;
+            while (i + 1 < slots.size()) {
+                // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
+                size_t j = 1;
+                while (i+j < slots.size() &&
+                        memcmp(prev.Hash(b, slots[i]), prev.Hash(b, slots[i+j]), CollisionByteLength - 1) == 0) {
+                    j++;
+                }
+
+                // 2c) Store (X_i ^ X_j, (i, j)) as back-pointers
+                for (size_t l = 0; l < j - 1; l++) {
+                    for (size_t m = l + 1; m < j; m++) {
+                        uint32_t sa = slots[i+l];
+                        uint32_t sb = slots[i+m];
+                        // Pairs sharing a child entry would repeat indices
+                        if (r > 1) {
+                            const uint32_t* pa = prev.Ptrs(b, sa);
+                            const uint32_t* pb = prev.Ptrs(b, sb);
+                            if (pa[0] == pb[0] || pa[0] == pb[1] || pa[1] == pb[0] || pa[1] == pb[1])
+                                continue;
+                        }
+                        const unsigned char* ha = prev.Hash(b, sa) + CollisionByteLength - 1;
+                        const unsigned char* hb = prev.Hash(b, sb) + CollisionByteLength - 1;
+                        for (size_t h = 0; h < newLen; h++)
+                            newHash[h] = ha[h] ^ hb[h];
+                        next.hashes[newHash[0]].insert(next.hashes[newHash[0]].end(), newHash + 1, newHash + newLen);
+                        next.ptrs[newHash[0]].push_back(EhPackPtr(b, sa));
+                        next.ptrs[newHash[0]].push_back(EhPackPtr(b, sb));
+                    }
+                }
+
+                i += j;
+            }
         }
-        goto deletesolution;
 
-invalidsolution:
-        invalidCount++;
+        // Only the back-pointers of earlier rounds are needed from here on
+        for (std::vector<unsigned char>& v : tables[r-1].hashes)
+            std::vector<unsigned char>().swap(v);
+        tables.push_back(std::move(next));
+        hashLen = newLen;
+    }
 
-deletesolution:
-        delete[] partialSoln;
+    // k+1) Find a collision on last 2n(k+1) bits
+    LogPrint("pow", "Final round:\n");
+    std::set<std::vector<eh_index>> solns;
+    const EhIndexTable& last = tables[K-1];
+    int invalidCount = 0;
+    for (size_t b = 0; b < nBuckets; b++) {
+        std::vector<uint32_t> slots = SortedSlots(last, b, last.hashLen);
+        size_t i = 0;
+        while (i + 1 < slots.size()) {
+            size_t j = 1;
+            while (i+j < slots.size() &&
+                    memcmp(last.Hash(b, slots[i]), last.Hash(b, slots[i+j]), last.hashLen) == 0) {
+                j++;
+            }
+
+            for (size_t l = 0; l < j - 1; l++) {
+                for (size_t m = l + 1; m < j; m++) {
+                    // Rebuild the indices only for candidate solutions
+                    std::vector<eh_index> soln;
+                    soln.reserve(1 << K);
+                    ExpandIndices(tables, K-1, EhPackPtr(b, slots[i+l]), soln);
+                    size_t mid = soln.size();
+                    ExpandIndices(tables, K-1, EhPackPtr(b, slots[i+m]), soln);
+                    if (soln[mid] < soln[0])
+                        std::rotate(soln.begin(), soln.begin() + mid, soln.end());
+
+                    std::vector<eh_index> sorted(soln);
+                    std::sort(sorted.begin(), sorted.end());
+                    if (std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end())
+                        solns.insert(soln);
+                    else
+                        invalidCount++;
+                }
+            }
+
+            i += j;
+        }
     }
     LogPrint("pow", "- Number of invalid solutions found: %d\n", invalidCount);
 
@@ -507,7 +1205,137 @@ deletesolution:
 }
 
 template<unsigned int N, unsigned int K>
-bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln)
+std::set<std::vector<eh_index>> Equihash<N,K>::BoundedSolve(const eh_HashState& base_state, size_t nMemoryBudget, size_t& nDropped)
+{
+    const size_t nBuckets = BoundedBuckets;
+    eh_index init_size { 1 << (CollisionBitLength + 1) };
+    nDropped = 0;
+
+    // Two hash arenas are reused alternately by consecutive rounds, while
+    // the back-pointers of every round are kept for ExpandIndices. This
+    // fixes the bytes needed for each slot of a bucket (BoundedSlotWidth),
+    // and so the number of slots that fit in the budget.
+    size_t maxHashLen = N/8 - 1;
+    size_t cap = std::min<size_t>(nMemoryBudget / BoundedMinMemory, (1u << EH_SLOT_BITS) - 1);
+    if (cap == 0)
+        throw std::runtime_error("Equihash memory budget is too small");
+    LogPrint("pow", "Bounded solver: %d slots per bucket (%d bytes)\n", cap, cap * BoundedMinMemory);
+
+    std::vector<unsigned char> hashArena[2];
+    hashArena[0].resize(nBuckets * cap * maxHashLen);
+    hashArena[1].resize(nBuckets * cap * maxHashLen);
+    std::vector<uint32_t> ptrArena(nBuckets * cap * (1 + 2 * (K - 1)));
+
+    // 1) Generate first list
+    LogPrint("pow", "Generating first list\n");
+    size_t hashLen = N/8;
+    std::vector<EhArenaTable> tables;
+    tables.reserve(K);
+    tables.emplace_back(hashLen - 1, 1, nBuckets, cap, hashArena[0].data(), ptrArena.data());
+    EhArenaTable& first = tables[0];
+    EhGenerateHashes(base_state, N/8, 0, init_size, [&first, &nDropped](eh_index i, const unsigned char* hash) {
+        if (!first.Push(hash[0], hash + 1, &i))
+            nDropped++;
+    });
+
+    // 3) Repeat step 2 until 2n/(k+1) bits remain
+    uint32_t* nextPtrs = ptrArena.data() + nBuckets * cap;
+    for (int r = 1; r < K; r++) {
+        LogPrint("pow", "Round %d:\n", r);
+        size_t newLen = hashLen - CollisionByteLength;
+        EhArenaTable next(newLen - 1, 2, nBuckets, cap, hashArena[r % 2].data(), nextPtrs);
+        nextPtrs += nBuckets * cap * 2;
+        const EhArenaTable& prev = tables[r-1];
+        unsigned char newHash[N/8];
+        for (size_t b = 0; b < nBuckets; b++) {
+            // 2a) Sort the bucket on the rest of the collision bytes
+            std::vector<uint32_t> slots = SortedSlots(prev, b, CollisionByteLength - 1);
+
+            size_t i = 0;
+            while (i + 1 < slots.size()) {
+                // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
+                size_t j = 1;
+                while (i+j < slots.size() &&
+                        memcmp(prev.Hash(b, slots[i]), prev.Hash(b, slots[i+j]), CollisionByteLength - 1) == 0) {
+                    j++;
+                }
+
+                // 2c) Store (X_i ^ X_j, (i, j)) as back-pointers, dropping
+                // them if their bucket is already full
+                for (size_t l = 0; l < j - 1; l++) {
+                    for (size_t m = l + 1; m < j; m++) {
+                        uint32_t sa = slots[i+l];
+                        uint32_t sb = slots[i+m];
+                        // Pairs sharing a child entry would repeat indices
+                        if (r > 1) {
+                            const uint32_t* pa = prev.Ptrs(b, sa);
+                            const uint32_t* pb = prev.Ptrs(b, sb);
+                            if (pa[0] == pb[0] || pa[0] == pb[1] || pa[1] == pb[0] || pa[1] == pb[1])
+                                continue;
+                        }
+                        const unsigned char* ha = prev.Hash(b, sa) + CollisionByteLength - 1;
+                        const unsigned char* hb = prev.Hash(b, sb) + CollisionByteLength - 1;
+                        for (size_t h = 0; h < newLen; h++)
+                            newHash[h] = ha[h] ^ hb[h];
+                        uint32_t p[2] = { EhPackPtr(b, sa), EhPackPtr(b, sb) };
+                        if (!next.Push(newHash[0], newHash + 1, p))
+                            nDropped++;
+                    }
+                }
+
+                i += j;
+            }
+        }
+
+        tables.push_back(next);
+        hashLen = newLen;
+    }
+
+    // k+1) Find a collision on last 2n(k+1) bits
+    LogPrint("pow", "Final round:\n");
+    std::set<std::vector<eh_index>> solns;
+    const EhArenaTable& last = tables[K-1];
+    int invalidCount = 0;
+    for (size_t b = 0; b < nBuckets; b++) {
+        std::vector<uint32_t> slots = SortedSlots(last, b, last.hashLen);
+        size_t i = 0;
+        while (i + 1 < slots.size()) {
+            size_t j = 1;
+            while (i+j < slots.size() &&
+                    memcmp(last.Hash(b, slots[i]), last.Hash(b, slots[i+j]), last.hashLen) == 0) {
+                j++;
+            }
+
+            for (size_t l = 0; l < j - 1; l++) {
+                for (size_t m = l + 1; m < j; m++) {
+                    std::vector<eh_index> soln;
+                    soln.reserve(1 << K);
+                    ExpandIndices(tables, K-1, EhPackPtr(b, slots[i+l]), soln);
+                    size_t mid = soln.size();
+                    ExpandIndices(tables, K-1, EhPackPtr(b, slots[i+m]), soln);
+                    if (soln[mid] < soln[0])
+                        std::rotate(soln.begin(), soln.begin() + mid, soln.end());
+
+                    std::vector<eh_index> sorted(soln);
+                    std::sort(sorted.begin(), sorted.end());
+                    if (std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end())
+                        solns.insert(soln);
+                    else
+                        invalidCount++;
+                }
+            }
+
+            i += j;
+        }
+    }
+    LogPrint("pow", "- Number of invalid solutions found: %d\n", invalidCount);
+    LogPrint("pow", "- Number of rows dropped by the memory cap: %d\n", nDropped);
+
+    return solns;
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln)
 {
     eh_index soln_size { 1u << K };
     if (soln.size() != soln_size) {
@@ -515,10 +1343,12 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
         return false;
     }
 
+    std::vector<unsigned char> hashes(soln_size * N/8);
+    EhHashIndices(base_state, soln.data(), soln_size, hashes.data(), N/8);
     std::vector<FullStepRow<FinalFullWidth>> X;
     X.reserve(soln_size);
-    for (eh_index i : soln) {
-        X.emplace_back(N, base_state, i);
+    for (eh_index i = 0; i < soln_size; i++) {
+        X.emplace_back(&hashes[i * N/8], N/8, soln[i]);
     }
 
     size_t hashLen = N/8;
@@ -551,20 +1381,176 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, const std::vector<eh_index>& soln)
+{
+    const size_t soln_size = 1 << K;
+    if (soln.size() != soln_size) {
+        LogPrint("pow", "Invalid solution size: %d\n", soln.size());
+        return false;
+    }
+
+    // The tree is checked bottom-up in place, without allocating. After
+    // level r, hashes[i] holds the XOR of the hashes of the subtree that
+    // starts at soln[i].
+    unsigned char hashes[soln_size][N/8];
+    EhHashIndices(base_state, soln.data(), soln_size, hashes[0], N/8);
+
+    for (size_t r = 0; r < K; r++) {
+        size_t half = 1 << r;
+        size_t pos = r * CollisionByteLength;
+        for (size_t i = 0; i < soln_size; i += 2*half) {
+            if (memcmp(hashes[i] + pos, hashes[i+half] + pos, CollisionByteLength) != 0) {
+                LogPrint("pow", "Invalid solution: invalid collision length between StepRows\n");
+                return false;
+            }
+            if (soln[i+half] < soln[i]) {
+                LogPrint("pow", "Invalid solution: Index tree incorrectly ordered\n");
+                return false;
+            }
+            for (size_t h = pos + CollisionByteLength; h < N/8; h++)
+                hashes[i][h] ^= hashes[i+half][h];
+        }
+    }
+
+    for (size_t h = K * CollisionByteLength; h < N/8; h++) {
+        if (hashes[0][h] != 0)
+            return false;
+    }
+
+    eh_index sorted[soln_size];
+    std::copy(soln.begin(), soln.end(), sorted);
+    std::sort(sorted, sorted + soln_size);
+    if (std::adjacent_find(sorted, sorted + soln_size) != sorted + soln_size) {
+        LogPrint("pow", "Invalid solution: duplicate indices\n");
+        return false;
+    }
+    return true;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state);
 template std::set<std::vector<eh_index>> Equihash<96,3>::BasicSolve(const eh_HashState& base_state);
-template std::set<std::vector<eh_index>> Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state);
-template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+template std::set<std::vector<eh_index>> Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state, EhSortMode sortMode);
+template std::set<std::vector<eh_index>> Equihash<96,3>::ParallelSolve(const eh_HashState& base_state, unsigned int nThreads);
+template std::set<std::vector<eh_index>> Equihash<96,3>::IndexedSolve(const eh_HashState& base_state);
+template std::set<std::vector<eh_index>> Equihash<96,3>::BoundedSolve(const eh_HashState& base_state, size_t nMemoryBudget, size_t& nDropped);
+template bool Equihash<96,3>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, const std::vector<eh_index>& soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state);
 template std::set<std::vector<eh_index>> Equihash<96,5>::BasicSolve(const eh_HashState& base_state);
-template std::set<std::vector<eh_index>> Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state);
-template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+template std::set<std::vector<eh_index>> Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state, EhSortMode sortMode);
+template std::set<std::vector<eh_index>> Equihash<96,5>::ParallelSolve(const eh_HashState& base_state, unsigned int nThreads);
+template std::set<std::vector<eh_index>> Equihash<96,5>::IndexedSolve(const eh_HashState& base_state);
+template std::set<std::vector<eh_index>> Equihash<96,5>::BoundedSolve(const eh_HashState& base_state, size_t nMemoryBudget, size_t& nDropped);
+template bool Equihash<96,5>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, const std::vector<eh_index>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
 template std::set<std::vector<eh_index>> Equihash<48,5>::BasicSolve(const eh_HashState& base_state);
-template std::set<std::vector<eh_index>> Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state);
-template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+template std::set<std::vector<eh_index>> Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state, EhSortMode sortMode);
+template std::set<std::vector<eh_index>> Equihash<48,5>::ParallelSolve(const eh_HashState& base_state, unsigned int nThreads);
+template std::set<std::vector<eh_index>> Equihash<48,5>::IndexedSolve(const eh_HashState& base_state);
+template std::set<std::vector<eh_index>> Equihash<48,5>::BoundedSolve(const eh_HashState& base_state, size_t nMemoryBudget, size_t& nDropped);
+template bool Equihash<48,5>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, const std::vector<eh_index>& soln);
+
+std::set<std::vector<eh_index>> CEquihashSolver::Solve(unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params)
+{
+    int64_t nStart = GetTimeMicros();
+    std::set<std::vector<eh_index>> solns = solve(n, k, base_state, params);
+    nTimeMicros += GetTimeMicros() - nStart;
+    nSolutions += solns.size();
+    nRuns++;
+    return solns;
+}
+
+double CEquihashSolver::GetSolutionsPerSecond() const
+{
+    uint64_t nMicros = nTimeMicros;
+    return nMicros == 0 ? 0 : nSolutions * 1000000.0 / nMicros;
+}
+
+CEquihashSolverRegistry::CEquihashSolverRegistry()
+{
+    Add("basic", "Reference solver; slow, for testing",
+        [](unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params) {
+            std::set<std::vector<eh_index>> solns;
+            EhBasicSolve(n, k, base_state, solns);
+            return solns;
+        });
+    Add("optimised", "Truncated-index solver with radix-sorted rounds",
+        [](unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params) {
+            std::set<std::vector<eh_index>> solns;
+            EhOptimisedSolve(n, k, base_state, solns);
+            return solns;
+        });
+    Add("parallel", "Truncated-index solver on -equihashthreads threads",
+        [](unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params) {
+            std::set<std::vector<eh_index>> solns;
+            EhParallelSolve(n, k, base_state, solns, params.nThreads);
+            return solns;
+        });
+    Add("indexed", "Index-pointer solver that stores back-pointers instead of indices",
+        [](unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params) {
+            std::set<std::vector<eh_index>> solns;
+            EhIndexedSolve(n, k, base_state, solns);
+            return solns;
+        });
+    Add("bounded", "Index-pointer solver limited to -equihashmaxmem MiB",
+        [](unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params) {
+            std::set<std::vector<eh_index>> solns;
+            size_t nDropped;
+            EhBoundedSolve(n, k, base_state, solns, params.nMemoryBudget, nDropped);
+            return solns;
+        });
+}
+
+bool CEquihashSolverRegistry::Add(const std::string& name, const std::string& description, CEquihashSolver::SolveFn solve)
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    if (solvers.count(name))
+        return false;
+    solvers[name].reset(new CEquihashSolver(name, description, solve));
+    return true;
+}
+
+CEquihashSolver* CEquihashSolverRegistry::Get(const std::string& name)
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    auto it = solvers.find(name);
+    return it == solvers.end() ? NULL : it->second.get();
+}
+
+std::vector<CEquihashSolver*> CEquihashSolverRegistry::List()
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    std::vector<CEquihashSolver*> ret;
+    for (const auto& entry : solvers)
+        ret.push_back(entry.second.get());
+    return ret;
+}
+
+static CEquihashSolverRegistry& GetSolverRegistry()
+{
+    static CEquihashSolverRegistry registry;
+    return registry;
+}
+
+bool EhRegisterSolver(const std::string& name, const std::string& description, CEquihashSolver::SolveFn solve)
+{
+    return GetSolverRegistry().Add(name, description, solve);
+}
+
+CEquihashSolver* EhGetSolver(const std::string& name)
+{
+    return GetSolverRegistry().Get(name);
+}
+
+std::vector<CEquihashSolver*> EhListSolvers()
+{
+    return GetSolverRegistry().List();
+}
@@ -11,11 +11,17 @@
 
 #include "sodium.h"
 
+#include <atomic>
 #include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <boost/static_assert.hpp>
+#include <boost/thread/mutex.hpp>
 
 typedef crypto_generichash_blake2b_state eh_HashState;
 typedef uint32_t eh_index;
@@ -24,6 +30,14 @@ typedef uint8_t eh_trunc;
 eh_index ArrayToEhIndex(const unsigned char* array);
 eh_trunc TruncateIndex(const eh_index i, const unsigned int ilen);
 
+/**
+ * Writes H(base_state || i) for each of count indices to out, hashLen bytes
+ * per index. Uses 4-way AVX2 BLAKE2b when the CPU supports it.
+ */
+void EhHashIndices(const eh_HashState& base_state, const eh_index* indices, size_t count, unsigned char* out, size_t hashLen);
+/** Whether EhHashIndices was built with its AVX2 path, which also needs the CPU to support it */
+bool EhHashIndicesAVX2Built();
+
 template<size_t WIDTH>
 class StepRow
 {
@@ -35,7 +49,7 @@ protected:
     unsigned char hash[WIDTH];
 
 public:
-    StepRow(unsigned int n, const eh_HashState& base_state, eh_index i);
+    StepRow(const unsigned char* hashIn, size_t hInLen);
     ~StepRow() { }
 
     template<size_t W>
@@ -43,9 +57,10 @@ public:
 
     bool IsZero(size_t len);
     std::string GetHex(size_t len) { return HexStr(hash, hash+len); }
+    inline unsigned char HashByte(size_t i) const { return hash[i]; }
 
     template<size_t W>
-    friend bool HasCollision(StepRow<W>& a, StepRow<W>& b, int l);
+    friend bool HasCollision(const StepRow<W>& a, const StepRow<W>& b, int l);
 };
 
 class CompareSR
@@ -61,7 +76,7 @@ public:
 };
 
 template<size_t WIDTH>
-bool HasCollision(StepRow<WIDTH>& a, StepRow<WIDTH>& b, int l);
+bool HasCollision(const StepRow<WIDTH>& a, const StepRow<WIDTH>& b, int l);
 
 template<size_t WIDTH>
 class FullStepRow : public StepRow<WIDTH>
@@ -72,7 +87,7 @@ class FullStepRow : public StepRow<WIDTH>
     using StepRow<WIDTH>::hash;
 
 public:
-    FullStepRow(unsigned int n, const eh_HashState& base_state, eh_index i);
+    FullStepRow(const unsigned char* hashIn, size_t hInLen, eh_index i);
     ~FullStepRow() { }
 
     FullStepRow(const FullStepRow<WIDTH>& a) : StepRow<WIDTH> {a} { }
@@ -96,7 +111,7 @@ class TruncatedStepRow : public StepRow<WIDTH>
     using StepRow<WIDTH>::hash;
 
 public:
-    TruncatedStepRow(unsigned int n, const eh_HashState& base_state, eh_index i, unsigned int ilen);
+    TruncatedStepRow(const unsigned char* hashIn, size_t hInLen, eh_index i, unsigned int ilen);
     ~TruncatedStepRow() { }
 
     TruncatedStepRow(const TruncatedStepRow<WIDTH>& a) : StepRow<WIDTH> {a} { }
@@ -108,6 +123,12 @@ public:
     eh_trunc* GetTruncatedIndices(size_t len, size_t lenIndices) const;
 };
 
+enum EhSortMode
+{
+    EH_SORT_COMPARISON, // std::sort over the rows
+    EH_SORT_BUCKET,     // radix sort on the collision bytes
+};
+
 inline constexpr const size_t max(const size_t A, const size_t B) { return A > B ? A : B; }
 
 template<unsigned int N, unsigned int K>
@@ -119,6 +140,8 @@ private:
     BOOST_STATIC_ASSERT((N/(K+1)) % 8 == 0);
     BOOST_STATIC_ASSERT((N/(K+1)) + 1 < 8*sizeof(eh_index));
 
+    bool CullPartialSolution(const eh_HashState& base_state, const eh_trunc* partialSoln, std::set<std::vector<eh_index>>& solns);
+
 public:
     enum { CollisionBitLength=N/(K+1) };
     enum { CollisionByteLength=CollisionBitLength/8 };
@@ -126,13 +149,21 @@ public:
     enum : size_t { FinalFullWidth=2*CollisionByteLength+sizeof(eh_index)*(1 << (K)) };
     enum : size_t { TruncatedWidth=max((N/8)+sizeof(eh_trunc), 2*CollisionByteLength+sizeof(eh_trunc)*(1 << (K-1))) };
     enum : size_t { FinalTruncatedWidth=max((N/8)+sizeof(eh_trunc), 2*CollisionByteLength+sizeof(eh_trunc)*(1 << (K))) };
+    enum : size_t { BoundedBuckets=256 };
+    enum : size_t { BoundedSlotWidth=2*(N/8-1)+sizeof(uint32_t)*(1+2*(K-1)) };
+    // Smallest budget BoundedSolve accepts: one slot in every bucket
+    enum : size_t { BoundedMinMemory=BoundedBuckets*BoundedSlotWidth };
 
     Equihash() { }
 
     int InitialiseState(eh_HashState& base_state);
     std::set<std::vector<eh_index>> BasicSolve(const eh_HashState& base_state);
-    std::set<std::vector<eh_index>> OptimisedSolve(const eh_HashState& base_state);
-    bool IsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+    std::set<std::vector<eh_index>> OptimisedSolve(const eh_HashState& base_state, EhSortMode sortMode = EH_SORT_BUCKET);
+    std::set<std::vector<eh_index>> ParallelSolve(const eh_HashState& base_state, unsigned int nThreads);
+    std::set<std::vector<eh_index>> IndexedSolve(const eh_HashState& base_state);
+    std::set<std::vector<eh_index>> BoundedSolve(const eh_HashState& base_state, size_t nMemoryBudget, size_t& nDropped);
+    bool BasicIsValidSolution(const eh_HashState& base_state, std::vector<eh_index> soln);
+    bool IsValidSolution(const eh_HashState& base_state, const std::vector<eh_index>& soln);
 };
 
 #include "equihash.tcc"
@@ -164,13 +195,60 @@ static Equihash<48,5> Eh48_5;
     }
 
 #define EhOptimisedSolve(n, k, base_state, solns)   \
-    if (n == 96 && k == 3) {                        \
-        solns = Eh96_3.OptimisedSolve(base_state);  \
-    } else if (n == 96 && k == 5) {                 \
-        solns = Eh96_5.OptimisedSolve(base_state);  \
-    } else if (n == 48 && k == 5) {                 \
-        solns = Eh48_5.OptimisedSolve(base_state);  \
-    } else {                                        \
+    EhOptimisedSolveSort(n, k, base_state, solns, EH_SORT_BUCKET)
+
+#define EhOptimisedSolveSort(n, k, base_state, solns, sortMode)   \
+    if (n == 96 && k == 3) {                                      \
+        solns = Eh96_3.OptimisedSolve(base_state, sortMode);      \
+    } else if (n == 96 && k == 5) {                               \
+        solns = Eh96_5.OptimisedSolve(base_state, sortMode);      \
+    } else if (n == 48 && k == 5) {                               \
+        solns = Eh48_5.OptimisedSolve(base_state, sortMode);      \
+    } else {                                                      \
+        throw std::invalid_argument("Unsupported Equihash parameters"); \
+    }
+
+#define EhParallelSolve(n, k, base_state, solns, nThreads)   \
+    if (n == 96 && k == 3) {                                  \
+        solns = Eh96_3.ParallelSolve(base_state, nThreads);   \
+    } else if (n == 96 && k == 5) {                           \
+        solns = Eh96_5.ParallelSolve(base_state, nThreads);   \
+    } else if (n == 48 && k == 5) {                           \
+        solns = Eh48_5.ParallelSolve(base_state, nThreads);   \
+    } else {                                                  \
+        throw std::invalid_argument("Unsupported Equihash parameters"); \
+    }
+
+#define EhIndexedSolve(n, k, base_state, solns)   \
+    if (n == 96 && k == 3) {                      \
+        solns = Eh96_3.IndexedSolve(base_state);  \
+    } else if (n == 96 && k == 5) {               \
+        solns = Eh96_5.IndexedSolve(base_state);  \
+    } else if (n == 48 && k == 5) {               \
+        solns = Eh48_5.IndexedSolve(base_state);  \
+    } else {                                      \
+        throw std::invalid_argument("Unsupported Equihash parameters"); \
+    }
+
+#define EhBoundedSolve(n, k, base_state, solns, nMemoryBudget, nDropped)   \
+    if (n == 96 && k == 3) {                                                \
+        solns = Eh96_3.BoundedSolve(base_state, nMemoryBudget, nDropped);   \
+    } else if (n == 96 && k == 5) {                                         \
+        solns = Eh96_5.BoundedSolve(base_state, nMemoryBudget, nDropped);   \
+    } else if (n == 48 && k == 5) {                                         \
+        solns = Eh48_5.BoundedSolve(base_state, nMemoryBudget, nDropped);   \
+    } else {                                                                \
+        throw std::invalid_argument("Unsupported Equihash parameters");     \
+    }
+
+#define EhBoundedMinMemory(n, k, ret)            \
+    if (n == 96 && k == 3) {                     \
+        ret = Equihash<96,3>::BoundedMinMemory;  \
+    } else if (n == 96 && k == 5) {              \
+        ret = Equihash<96,5>::BoundedMinMemory;  \
+    } else if (n == 48 && k == 5) {              \
+        ret = Equihash<48,5>::BoundedMinMemory;  \
+    } else {                                     \
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
 
@@ -185,4 +263,85 @@ static Equihash<48,5> Eh48_5;
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
 
+#define EhBasicIsValidSolution(n, k, base_state, soln, ret)   \
+    if (n == 96 && k == 3) {                                  \
+        ret = Eh96_3.BasicIsValidSolution(base_state, soln);  \
+    } else if (n == 96 && k == 5) {                           \
+        ret = Eh96_5.BasicIsValidSolution(base_state, soln);  \
+    } else if (n == 48 && k == 5) {                           \
+        ret = Eh48_5.BasicIsValidSolution(base_state, soln);  \
+    } else {                                                  \
+        throw std::invalid_argument("Unsupported Equihash parameters"); \
+    }
+
+/** Settings passed to every registered solver; each uses what applies to it */
+struct EhSolverParams
+{
+    unsigned int nThreads;
+    size_t nMemoryBudget;
+
+    EhSolverParams() : nThreads(1), nMemoryBudget(0) { }
+};
+
+/**
+ * An Equihash solver that can be selected by name at run time. Solve()
+ * keeps running totals so that solvers can be compared in production.
+ */
+class CEquihashSolver
+{
+public:
+    typedef std::function<std::set<std::vector<eh_index>>(unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params)> SolveFn;
+
+private:
+    std::string name;
+    std::string description;
+    SolveFn solve;
+
+    std::atomic<uint64_t> nRuns;
+    std::atomic<uint64_t> nSolutions;
+    std::atomic<uint64_t> nTimeMicros;
+
+public:
+    CEquihashSolver(const std::string& nameIn, const std::string& descriptionIn, SolveFn solveIn) :
+        name(nameIn), description(descriptionIn), solve(solveIn), nRuns(0), nSolutions(0), nTimeMicros(0) { }
+
+    const std::string& GetName() const { return name; }
+    const std::string& GetDescription() const { return description; }
+
+    std::set<std::vector<eh_index>> Solve(unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params);
+
+    uint64_t GetRuns() const { return nRuns; }
+    uint64_t GetSolutions() const { return nSolutions; }
+    double GetSeconds() const { return nTimeMicros * 0.000001; }
+    double GetSolutionsPerSecond() const;
+};
+
+/**
+ * Solvers by name, starting with the built-in ones. Solvers are never
+ * removed, so the pointers handed out stay valid as long as the registry.
+ */
+class CEquihashSolverRegistry
+{
+private:
+    boost::mutex cs;
+    std::map<std::string, std::unique_ptr<CEquihashSolver>> solvers;
+
+public:
+    CEquihashSolverRegistry();
+
+    /** Add a solver; returns false if the name is already taken */
+    bool Add(const std::string& name, const std::string& description, CEquihashSolver::SolveFn solve);
+    /** Look up a solver by name, or NULL if there is none */
+    CEquihashSolver* Get(const std::string& name);
+    /** All solvers, ordered by name */
+    std::vector<CEquihashSolver*> List();
+};
+
+/** Register a solver with the registry used by the miner and RPC; returns false if the name is already taken */
+bool EhRegisterSolver(const std::string& name, const std::string& description, CEquihashSolver::SolveFn solve);
+/** Look up a registered solver by name, or NULL if there is none */
+CEquihashSolver* EhGetSolver(const std::string& name);
+/** All registered solvers, ordered by name */
+std::vector<CEquihashSolver*> EhListSolvers();
+
 #endif // BITCOIN_EQUIHASH_H
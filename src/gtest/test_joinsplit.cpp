@@ -34,6 +34,7 @@ void test_full_api(ZCJoinSplit* js)
     uint256 rt = tree.root();
     boost::array<ZCNoteEncryption::Ciphertext, 2> ciphertexts;
     boost::array<unsigned char, ZKSNARK_PROOF_SIZE> proof;
+    std::vector<ZCJoinSplit::Statement> statements;
 
     {
         boost::array<JSInput, 2> inputs = {
@@ -79,6 +80,9 @@ void test_full_api(ZCJoinSplit* js)
         rt
     ));
 
+    statements.push_back({proof, pubKeyHash, randomSeed, macs, nullifiers,
+                          commitments, vpub_old, vpub_new, rt});
+
     // Recipient should decrypt
     // Now the recipient should spend the money again
     auto h_sig = js->h_sig(randomSeed, nullifiers, pubKeyHash);
@@ -152,6 +156,19 @@ void test_full_api(ZCJoinSplit* js)
         vpub_new,
         rt
     ));
+
+    statements.push_back({proof, pubKeyHash, randomSeed, macs, nullifiers,
+                          commitments, vpub_old, vpub_new, rt});
+
+    // Both proofs should verify as one batch...
+    ASSERT_TRUE(js->verifyBatch(statements));
+
+    // ...but not if either of them is wrong
+    for (size_t i = 0; i < statements.size(); i++) {
+        std::vector<ZCJoinSplit::Statement> bad(statements);
+        bad[i].vpub_new += 1;
+        ASSERT_FALSE(js->verifyBatch(bad));
+    }
 }
 
 TEST(joinsplit, h_sig)
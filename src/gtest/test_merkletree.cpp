@@ -337,3 +337,91 @@ TEST(merkletree, testZeroElements) {
         ASSERT_TRUE(newTree.root() == oldroot);
     }
 }
+
+template<typename T>
+std::vector<unsigned char> serialized(const T& object)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << object;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+TEST(merkletree, appendBatch) {
+    // Enough distinct leaves to fill the tree
+    std::vector<libzcash::SHA256Compress> leaves;
+    for (size_t i = 0; i < (size_t(1) << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING); i++) {
+        uint256 leaf;
+        *leaf.begin() = i + 1;
+        leaves.push_back(leaf);
+    }
+
+    for (size_t start = 0; start < 5; start++) {
+        for (size_t batch = 1; batch < 20; batch++) {
+            ZCTestingIncrementalMerkleTree tree;
+            ZCTestingIncrementalMerkleTree batchTree;
+            for (size_t i = 0; i < start; i++) {
+                tree.append(leaves[i]);
+                batchTree.append(leaves[i]);
+            }
+            ZCTestingIncrementalWitness witness = tree.witness();
+            ZCTestingIncrementalWitness batchWitness = batchTree.witness();
+
+            for (size_t i = start; i < leaves.size(); i += batch) {
+                size_t end = std::min(leaves.size(), i + batch);
+                std::vector<libzcash::SHA256Compress> objs(leaves.begin() + i, leaves.begin() + end);
+
+                BOOST_FOREACH(const libzcash::SHA256Compress& obj, objs) {
+                    tree.append(obj);
+                    witness.append(obj);
+                }
+                batchTree.append_batch(objs);
+                batchWitness.append_batch(objs);
+
+                ASSERT_TRUE(serialized(tree) == serialized(batchTree));
+                ASSERT_TRUE(serialized(witness) == serialized(batchWitness));
+                ASSERT_TRUE(tree.root() == batchTree.root());
+                ASSERT_TRUE(witness.root() == batchWitness.root());
+            }
+        }
+    }
+
+    // Filling the tree exactly is fine, but not going past it
+    ZCTestingIncrementalMerkleTree tree;
+    std::vector<libzcash::SHA256Compress> fill(size_t(1) << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING);
+    tree.append_batch(fill);
+    ASSERT_THROW(tree.append_batch(std::vector<libzcash::SHA256Compress>(1)), std::runtime_error);
+}
+
+TEST(merkletree, delta) {
+    ZCIncrementalMerkleTree base;
+    ZCIncrementalMerkleTree tree;
+
+    for (size_t i = 0; i < 300; i++) {
+        uint256 leaf;
+        *leaf.begin() = i & 0xff;
+        *(leaf.begin() + 1) = i >> 8;
+        tree.append(leaf);
+
+        // Deltas against the tree's earlier states, and against
+        // trees it did not grow from
+        ZCIncrementalMerkleTree other;
+        other.append(uint256());
+        BOOST_FOREACH(const ZCIncrementalMerkleTree& from, std::vector<ZCIncrementalMerkleTree>({base, ZCIncrementalMerkleTree(), other})) {
+            ZCIncrementalMerkleTree rebuilt(from, tree.delta(from));
+            ASSERT_TRUE(serialized(rebuilt) == serialized(tree));
+            ASSERT_TRUE(rebuilt.root() == tree.root());
+        }
+
+        if (i % 100 == 0) {
+            base = tree;
+        }
+    }
+
+    // Only the parents that changed are in a delta
+    ASSERT_TRUE(tree.delta(tree).changed_parents.empty());
+
+    // A delta cannot refer to parents the tree does not have
+    ZCIncrementalMerkleTreeDelta bad = tree.delta(base);
+    bad.num_parents = 0;
+    ASSERT_THROW(ZCIncrementalMerkleTree(base, bad), std::ios_base::failure);
+}
@@ -98,6 +98,65 @@ TEST(noteencryption, api)
     }
 }
 
+TEST(noteencryption, decrypt_batch)
+{
+    std::vector<uint256> sk_encs;
+    std::vector<ZCNoteDecryption> keys;
+    for (size_t i = 0; i < 3; i++) {
+        sk_encs.push_back(ZCNoteEncryption::generate_privkey(libzcash::random_uint252()));
+        keys.push_back(ZCNoteDecryption(sk_encs[i]));
+    }
+    uint256 pk_enc_other = ZCNoteEncryption::generate_pubkey(ZCNoteEncryption::generate_privkey(libzcash::random_uint252()));
+
+    ZCNoteEncryption::Plaintext message;
+    for (size_t i = 0; i < message.size(); i++) {
+        message[i] = (unsigned char) i;
+    }
+
+    // Two ciphertexts per ephemeral key, as in a JoinSplit. Key i % 4
+    // receives ciphertext i, where key 3 is not one of ours.
+    std::vector<ZCNoteDecryption::BatchItem> items;
+    for (size_t i = 0; i < 12; i += 2) {
+        uint256 hSig = libzcash::random_uint256();
+        ZCNoteEncryption encryptor(hSig);
+        for (unsigned char nonce = 0; nonce < 2; nonce++) {
+            size_t k = (i + nonce) % 4;
+            uint256 pk_enc = k < 3 ? ZCNoteEncryption::generate_pubkey(sk_encs[k]) : pk_enc_other;
+
+            ZCNoteDecryption::BatchItem item;
+            item.ciphertext = encryptor.encrypt(pk_enc, message);
+            item.epk = encryptor.get_epk();
+            item.hSig = hSig;
+            item.nonce = nonce;
+            items.push_back(item);
+        }
+    }
+
+    // Corrupted ciphertext
+    items[4].ciphertext[10] ^= 0xff;
+    // Wrong nonce
+    items[5].nonce = 0;
+
+    for (unsigned int nThreads = 1; nThreads <= 4; nThreads++) {
+        auto matches = ZCNoteDecryption::decryptBatch(keys, items, nThreads);
+
+        std::vector<size_t> expected = {0, 1, 2, 6, 8, 9, 10};
+        ASSERT_EQ(matches.size(), expected.size());
+        for (size_t i = 0; i < matches.size(); i++) {
+            ASSERT_EQ(matches[i].item, expected[i]);
+            ASSERT_EQ(matches[i].key, expected[i] % 4);
+            ASSERT_TRUE(matches[i].plaintext == message);
+
+            // Agrees with decrypt()
+            const auto& item = items[matches[i].item];
+            ASSERT_TRUE(keys[matches[i].key].decrypt(item.ciphertext, item.epk, item.hSig, item.nonce) == message);
+        }
+    }
+
+    ASSERT_TRUE(ZCNoteDecryption::decryptBatch(keys, {}).empty());
+    ASSERT_TRUE(ZCNoteDecryption::decryptBatch({}, items).empty());
+}
+
 uint256 test_prf(
     unsigned char distinguisher,
     uint252 seed_x,
@@ -14,11 +14,13 @@
 #include "amount.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/equihash.h"
 #include "consensus/validation.h"
 #include "key.h"
 #include "main.h"
 #include "miner.h"
 #include "net.h"
+#include "pourcache.h"
 #include "rpcserver.h"
 #include "script/standard.h"
 #include "scheduler.h"
@@ -28,6 +30,7 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
+#include "wallet/asyncpour.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
@@ -184,6 +187,8 @@ void Shutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsShard;
+        pcoinsShard = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -290,6 +295,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-pourcheckthreads=<n>", strprintf(_("Set the number of pour zk-SNARK verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_POURCHECK_THREADS));
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads looking up the inputs of blocks before they are connected (0 to %d, 0 = off, default: %d)"),
+        MAX_SCRIPTCHECK_THREADS, DEFAULT_PREFETCH_THREADS));
+    strUsage += HelpMessageOpt("-proverthreads=<n>", strprintf(_("Set the number of threads used to create each JoinSplit proof (0 = all cores, <0 = leave that many cores free, default: %d)"), 0));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "zcashd.pid"));
 #endif
@@ -344,8 +354,11 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf("Fees (in BTC/Kb) smaller than this are considered zero fee for transaction creation (default: %s)",
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
+    strUsage += HelpMessageOpt("-maxpourqueue=<n>", strprintf(_("Keep at most <n> zcrawpourasync pours waiting to be proved (default: %u)"), DEFAULT_MAX_POUR_QUEUE));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in BTC/kB) to add to transactions you send (default: %s)"), FormatMoney(payTxFee.GetFeePerK())));
+    strUsage += HelpMessageOpt("-pourworkers=<n>", strprintf(_("Set the number of threads proving zcrawpourasync pours (default: %d)"), DEFAULT_POUR_WORKERS));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads checking blocks during a rescan (0 = one per core, default: %d)"), DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
@@ -381,6 +394,9 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageOpt("-gen", strprintf(_("Generate coins (default: %u)"), 0));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), 1));
+    strUsage += HelpMessageOpt("-equihashthreads=<n>", strprintf(_("Set the number of threads each coin generation thread uses for the Equihash solver (default: %d)"), 1));
+    strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Equihash solver used for coin generation (default: bounded with -equihashmaxmem, parallel with -equihashthreads, otherwise optimised)"));
+    strUsage += HelpMessageOpt("-equihashmaxmem=<n>", strprintf(_("Limit the memory each coin generation thread uses for the Equihash solver to <n> MiB, which may miss some solutions (0 = no limit, default: %u)"), 0));
 #endif
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), 0));
@@ -389,6 +405,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
+        strUsage += HelpMessageOpt("-maxpourcachesize=<n>", strprintf("Limit size of the verified pour cache to <n> entries (default: %u)", DEFAULT_MAX_POUR_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in BTC/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -822,6 +839,25 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // Same for -pourcheckthreads
+    nPourCheckThreads = GetArg("-pourcheckthreads", DEFAULT_POURCHECK_THREADS);
+    if (nPourCheckThreads <= 0)
+        nPourCheckThreads += boost::thread::hardware_concurrency();
+    if (nPourCheckThreads <= 1)
+        nPourCheckThreads = 0;
+    else if (nPourCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nPourCheckThreads = MAX_SCRIPTCHECK_THREADS;
+
+    // The prefetching threads mostly wait for the disk, so they are not
+    // tied to the number of cores
+    nPrefetchThreads = std::max(0, std::min((int)GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_SCRIPTCHECK_THREADS));
+
+    // -proverthreads=0 lets the JoinSplit prover use every core
+    int nProverThreads = GetArg("-proverthreads", 0);
+    if (nProverThreads < 0)
+        nProverThreads = std::max(1, nProverThreads + (int)boost::thread::hardware_concurrency());
+    pzcashParams->setProverThreads(nProverThreads);
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MB) to allot for block & undo files
@@ -898,6 +934,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                                        mapArgs["-maxtxfee"], ::minRelayTxFee.ToString()));
         }
     }
+    if (mapArgs.count("-equihashsolver") && !EhGetSolver(mapArgs["-equihashsolver"]))
+        return InitError(strprintf(_("Unknown Equihash solver for -equihashsolver=<name>: '%s' (see getequihashsolvers)"), mapArgs["-equihashsolver"]));
+    if (GetArg("-equihashsolver", "") == "bounded" && GetArg("-equihashmaxmem", 0) <= 0)
+        return InitError(_("The bounded Equihash solver needs a memory budget, set with -equihashmaxmem=<n>"));
+    if (GetArg("-equihashmaxmem", 0) > 0) {
+        size_t nMinMemory;
+        EhBoundedMinMemory(Params().EquihashN(), Params().EquihashK(), nMinMemory);
+        if ((size_t)GetArg("-equihashmaxmem", 0) << 20 < nMinMemory)
+            return InitError(strprintf(_("Invalid -equihashmaxmem=<n>: '%s' (the Equihash solver needs at least %u KiB)"),
+                                       mapArgs["-equihashmaxmem"], (nMinMemory + 1023) >> 10));
+    }
     nTxConfirmTarget = GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", true);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", false);
@@ -957,12 +1004,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and header verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadEquihashCheck);
+        }
     }
 
+    LogPrintf("Using %u threads for pour verification\n", nPourCheckThreads);
+    for (int i=0; i<nPourCheckThreads-1; i++)
+        threadGroup.create_thread(&ThreadPourCheck);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1160,6 +1213,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsShard;
+                pcoinsShard = NULL;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1167,7 +1222,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                // Only needed for the prefetching threads to fill
+                if (nPrefetchThreads)
+                    pcoinsShard = new CCoinsViewShardedCache(pcoinscatcher);
+                pcoinsTip = new CCoinsViewCache(pcoinsShard ? (CCoinsView*)pcoinsShard : pcoinscatcher);
+
+                if (!pcoinsdbview->HaveCurrentAnchorFormat()) {
+                    strLoadError = _("The chainstate database stores anchors in an older format. You need to rebuild the database using -reindex");
+                    break;
+                }
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1424,6 +1487,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (mapArgs.count("-blocknotify"))
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
 
+    // Started only now that pcoinsShard, which they read, is there to stay
+    LogPrintf("Using %u threads for block input prefetching\n", nPrefetchThreads);
+    for (int i=0; i<nPrefetchThreads; i++)
+        threadGroup.create_thread(&ThreadCoinsPrefetch);
+
     uiInterface.InitMessage(_("Activating best chain..."));
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
     CValidationState state;
@@ -1488,6 +1556,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // Run the threads that prove zcrawpourasync pours
+        int nPourWorkers = std::max(1, (int)GetArg("-pourworkers", DEFAULT_POUR_WORKERS));
+        LogPrintf("Using %u threads for asynchronous pours\n", nPourWorkers);
+        for (int i = 0; i < nPourWorkers; i++)
+            threadGroup.create_thread(&ThreadPourWorker);
     }
 #endif
 
@@ -17,6 +17,7 @@
 #include "init.h"
 #include "merkleblock.h"
 #include "net.h"
+#include "pourcache.h"
 #include "pow.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -26,12 +27,14 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 
+#include <deque>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/math/distributions/poisson.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/static_assert.hpp>
 
@@ -54,6 +57,8 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPourCheckThreads = 0;
+int nPrefetchThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
@@ -543,6 +548,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewShardedCache *pcoinsShard = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1011,7 +1017,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state)
             if (state.PerformPourVerification()) {
                 // Ensure that zk-SNARKs verify
                 BOOST_FOREACH(const CPourTx &pour, tx.vpour) {
-                    if (!pour.Verify(*pzcashParams, tx.joinSplitPubKey)) {
+                    if (!VerifyPourCached(pour, *pzcashParams, tx.joinSplitPubKey)) {
                         return state.DoS(100, error("CheckTransaction(): pour does not verify"),
                                          REJECT_INVALID, "bad-txns-pour-verification-failed");
                     }
@@ -1602,6 +1608,15 @@ bool CScriptCheck::operator()() {
     return true;
 }
 
+bool CPourCheck::operator()() {
+    return pzcashParams->verifyBatch(statements);
+}
+
+bool CEquihashCheck::operator()() {
+    *pfValid = CheckEquihashSolution(pheader, Params());
+    return true;
+}
+
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
@@ -1932,6 +1947,195 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CEquihashCheck> equihashcheckqueue(16);
+
+void ThreadEquihashCheck() {
+    RenameThread("bitcoin-powcheck");
+    equihashcheckqueue.Thread();
+}
+
+// Each CPourCheck already holds a group of pours, so workers take one at
+// a time. CheckBlock runs outside cs_main, so cs_pourcheckqueue ensures
+// that only one caller at a time uses the queue.
+static CCheckQueue<CPourCheck> pourcheckqueue(1);
+static CCriticalSection cs_pourcheckqueue;
+
+void ThreadPourCheck() {
+    RenameThread("bitcoin-pourchk");
+    pourcheckqueue.Thread();
+}
+
+namespace {
+
+/** Lookups per prefetch task, so that one block's inputs are spread over the threads */
+static const size_t PREFETCH_BATCH_SIZE = 64;
+
+/**
+ * Either a block whose inputs are to be looked up, or some of those inputs:
+ * the coins spent, the serials revealed and the anchors of the pours.
+ */
+struct CPrefetchTask
+{
+    //! Block to read from disk, if not null
+    CDiskBlockPos pos;
+    //! Block that was already in memory
+    boost::shared_ptr<const CBlock> pblock;
+    std::vector<uint256> vTxids;
+    std::vector<uint256> vSerials;
+    std::vector<uint256> vAnchors;
+
+    size_t size() const { return vTxids.size() + vSerials.size() + vAnchors.size(); }
+};
+
+/**
+ * Looks up the inputs of the blocks about to be connected on the -prefetchthreads,
+ * so that ConnectBlock finds them in pcoinsShard rather than reading them from
+ * disk one at a time. The lookups go to pcoinsShard without cs_main; as it only
+ * caches what is on disk, nothing read here can change what ConnectBlock sees.
+ */
+class CCoinsPrefetcher
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    std::deque<CPrefetchTask> queue;
+    //! Blocks queued and not connected since pcoinsShard was last cleared
+    std::set<uint256> setBlocks;
+
+    // Splits a block's inputs into tasks at the front of the queue, so that
+    // they are looked up before those of the blocks queued after it
+    void Split(const CBlock& block)
+    {
+        std::set<uint256> setBlockTxids;
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            setBlockTxids.insert(tx.GetHash());
+
+        std::set<uint256> setTxids, setAnchors;
+        std::vector<CPrefetchTask> vTasks(1);
+        BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+            if (vTasks.back().size() >= PREFETCH_BATCH_SIZE)
+                vTasks.push_back(CPrefetchTask());
+            CPrefetchTask& task = vTasks.back();
+            if (!tx.IsCoinBase()) {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                    // Outputs created in this block are not on disk yet
+                    if (!setBlockTxids.count(txin.prevout.hash) && setTxids.insert(txin.prevout.hash).second)
+                        task.vTxids.push_back(txin.prevout.hash);
+                }
+            }
+            BOOST_FOREACH(const CPourTx& pour, tx.vpour) {
+                task.vSerials.insert(task.vSerials.end(), pour.serials.begin(), pour.serials.end());
+                if (setAnchors.insert(pour.anchor).second)
+                    task.vAnchors.push_back(pour.anchor);
+            }
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        BOOST_REVERSE_FOREACH(const CPrefetchTask& task, vTasks) {
+            if (task.size() > 0)
+                queue.push_front(task);
+        }
+        condWorker.notify_all();
+    }
+
+    void LookUp(const CPrefetchTask& task)
+    {
+        CCoinsViewShardedCache *pcoins = pcoinsShard;
+        if (pcoins == NULL)
+            return;
+        BOOST_FOREACH(const uint256& txid, task.vTxids)
+            pcoins->PrefetchCoins(txid);
+        BOOST_FOREACH(const uint256& serial, task.vSerials)
+            pcoins->PrefetchSerial(serial);
+        BOOST_FOREACH(const uint256& rt, task.vAnchors)
+            pcoins->PrefetchAnchor(rt);
+    }
+
+public:
+    void Add(const uint256& hash, const CDiskBlockPos& pos, const CBlock* pblock)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!setBlocks.insert(hash).second)
+            return;
+        CPrefetchTask task;
+        if (pblock)
+            task.pblock.reset(new CBlock(*pblock));
+        else
+            task.pos = pos;
+        queue.push_back(task);
+        condWorker.notify_one();
+    }
+
+    void Connected(const uint256& hash)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        setBlocks.erase(hash);
+    }
+
+    // Forgets every queued block once pcoinsShard has been cleared, so that
+    // the blocks still ahead of the tip are looked up again
+    void Reset()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        setBlocks.clear();
+        queue.clear();
+    }
+
+    void Loop()
+    {
+        while (true) {
+            CPrefetchTask task;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty())
+                    condWorker.wait(lock); // interruption point
+                std::swap(task, queue.front());
+                queue.pop_front();
+            }
+
+            if (!task.pos.IsNull()) {
+                // The block is only a hint of what to look up, so unlike
+                // ReadBlockFromDisk its header is not checked
+                CBlock block;
+                CAutoFile filein(OpenBlockFile(task.pos, true), SER_DISK, CLIENT_VERSION);
+                if (filein.IsNull())
+                    continue;
+                try {
+                    filein >> block;
+                } catch (const std::exception&) {
+                    continue;
+                }
+                Split(block);
+            } else if (task.pblock) {
+                Split(*task.pblock);
+            } else {
+                LookUp(task);
+            }
+            boost::this_thread::interruption_point();
+        }
+    }
+};
+
+CCoinsPrefetcher prefetcher;
+
+// Queues a block whose inputs ConnectBlock will soon need. pblock is either
+// NULL or the block itself, which saves reading it from disk.
+void PrefetchBlockInputs(const uint256& hash, const CDiskBlockPos& pos, const CBlock* pblock)
+{
+    if (nPrefetchThreads == 0 || pcoinsShard == NULL)
+        return;
+    if (pblock == NULL && pos.IsNull())
+        return;
+    prefetcher.Add(hash, pos, pblock);
+}
+
+}
+
+void ThreadCoinsPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    prefetcher.Loop();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2000,7 +2204,7 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, ZCIncrementalMerkleTree* pOldTree)
 {
     const CChainParams& chainparams = Params();
     AssertLockHeld(cs_main);
@@ -2090,6 +2294,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         // match what we asked for.
         assert(tree.root() == old_tree_root);
     }
+    // The block's bucket commitments, appended to the tree all at once
+    std::vector<libzcash::SHA256Compress> vCommitments;
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -2139,9 +2345,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         BOOST_FOREACH(const CPourTx &pour, tx.vpour) {
             BOOST_FOREACH(const uint256 &bucket_commitment, pour.commitments) {
-                // Insert the bucket commitments into our temporary tree.
-
-                tree.append(bucket_commitment);
+                vCommitments.push_back(bucket_commitment);
             }
         }
 
@@ -2149,6 +2353,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
+    if (pOldTree)
+        *pOldTree = tree;
+    // Insert the bucket commitments into our temporary tree.
+    tree.append_batch(vCommitments);
+
     view.PushAnchor(tree);
     blockundo.old_tree_root = old_tree_root;
 
@@ -2254,6 +2463,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         nLastSetChain = nNow;
     }
     size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+    if (pcoinsShard)
+        cacheSize += pcoinsShard->DynamicMemoryUsage();
     // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
     // The cache is over the limit, we have to write now.
@@ -2306,6 +2517,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        // That also cleared pcoinsShard of what was looked up ahead
+        prefetcher.Reset();
         nLastFlush = nNow;
     }
     if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
@@ -2415,6 +2628,8 @@ bool static DisconnectTip(CValidationState &state) {
     BOOST_FOREACH(const CTransaction &tx, block.vtx) {
         SyncWithWallets(tx, NULL);
     }
+    // Let wallets roll back the witnesses of their notes
+    GetMainSignals().ChainTip(pindexDelete, &block, ZCIncrementalMerkleTree(), false);
     return true;
 }
 
@@ -2443,10 +2658,12 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    // The commitment tree the block's commitments are appended to
+    ZCIncrementalMerkleTree oldTree;
     {
         CCoinsViewCache view(pcoinsTip);
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, &oldTree);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2454,6 +2671,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         mapBlockSource.erase(inv.hash);
+        prefetcher.Connected(inv.hash);
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
@@ -2480,6 +2698,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
         SyncWithWallets(tx, pblock);
     }
+    // ... and let them bring the witnesses of their notes up to date.
+    GetMainSignals().ChainTip(pindexNew, pblock, oldTree, true);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
@@ -2590,6 +2810,14 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
     }
     nHeight = nTargetHeight;
 
+    // Look up the inputs of the next blocks while the first ones connect.
+    for (size_t i = 0; i < std::min<size_t>(PREFETCH_BLOCKS_AHEAD, vpindexToConnect.size()); i++) {
+        CBlockIndex *pindexPrefetch = vpindexToConnect[vpindexToConnect.size() - 1 - i];
+        CBlock *pblockPrefetch = pindexPrefetch == pindexMostWork ? pblock : NULL;
+        if (pblockPrefetch || pindexPrefetch->nStatus & BLOCK_HAVE_DATA)
+            PrefetchBlockInputs(pindexPrefetch->GetBlockHash(), pindexPrefetch->GetBlockPos(), pblockPrefetch);
+    }
+
     // Connect new blocks.
     BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
         if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
@@ -2918,10 +3146,10 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW, bool fCheckSolution)
 {
     // Check Equihash solution is valid
-    if (fCheckPOW && !CheckEquihashSolution(&block, Params()))
+    if (fCheckPOW && fCheckSolution && !CheckEquihashSolution(&block, Params()))
         return state.DoS(100, error("CheckBlockHeader(): Equihash solution invalid"),
                          REJECT_INVALID, "invalid-solution");
 
@@ -2938,6 +3166,54 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
+/**
+ * Verifies the zk-SNARKs of every pour in the block in batches, spread
+ * over the pour-checking threads. Only if a batch fails are the pours
+ * verified one by one, to reject the block with the same error that
+ * CheckTransaction would have given.
+ */
+static bool CheckBlockPours(const CBlock& block, CValidationState& state)
+{
+    // Pours verified when their transaction entered the mempool are skipped
+    std::vector<ZCJoinSplit::Statement> statements;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        BOOST_FOREACH(const CPourTx& pour, tx.vpour)
+            if (!IsPourVerificationCached(GetPourCacheKey(pour, tx.joinSplitPubKey)))
+                statements.push_back(pour.GetStatement(tx.joinSplitPubKey));
+    if (statements.empty())
+        return true;
+
+    // Split the pours into one batch per pour-checking thread, counting
+    // the calling thread, when the queue is free
+    TRY_LOCK(cs_pourcheckqueue, lockQueue);
+    if (nPourCheckThreads && lockQueue && statements.size() > 1) {
+        size_t nBatches = std::min<size_t>(nPourCheckThreads, statements.size());
+        std::vector<CPourCheck> vChecks;
+        for (size_t i = 0; i < nBatches; i++) {
+            std::vector<ZCJoinSplit::Statement> batch(
+                statements.begin() + statements.size() * i / nBatches,
+                statements.begin() + statements.size() * (i + 1) / nBatches);
+            vChecks.push_back(CPourCheck(batch));
+        }
+        CCheckQueueControl<CPourCheck> control(&pourcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+    } else if (pzcashParams->verifyBatch(statements)) {
+        return true;
+    }
+
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        BOOST_FOREACH(const CPourTx& pour, tx.vpour) {
+            if (!VerifyPourCached(pour, *pzcashParams, tx.joinSplitPubKey, false)) {
+                return state.DoS(100, error("CheckTransaction(): pour does not verify"),
+                                 REJECT_INVALID, "bad-txns-pour-verification-failed");
+            }
+        }
+    }
+    return true;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -2981,10 +3257,18 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             return state.DoS(100, error("CheckBlock(): more than one coinbase"),
                              REJECT_INVALID, "bad-cb-multiple");
 
-    // Check transactions
+    // Check transactions. Their pour proofs are verified afterwards, all
+    // at once.
+    bool fPourVerify = state.PerformPourVerification();
+    state.SetPerformPourVerification(false);
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
+        if (!CheckTransaction(tx, state)) {
+            state.SetPerformPourVerification(fPourVerify);
             return error("CheckBlock(): CheckTransaction failed");
+        }
+    state.SetPerformPourVerification(fPourVerify);
+    if (fPourVerify && !CheckBlockPours(block, state))
+        return error("CheckBlock(): CheckBlockPours failed");
 
     unsigned int nSigOps = 0;
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
@@ -3101,7 +3385,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex)
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool fCheckSolution)
 {
     const CChainParams& chainparams = Params();
     AssertLockHeld(cs_main);
@@ -3119,7 +3403,7 @@ bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBloc
         return true;
     }
 
-    if (!CheckBlockHeader(block, state))
+    if (!CheckBlockHeader(block, state, true, fCheckSolution))
         return false;
 
     // Get prev block index
@@ -3235,6 +3519,11 @@ bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool
             return error("%s: CheckBlock FAILED", __func__);
         }
 
+        // Start looking up the block's inputs while it is stored, if it
+        // is going to be connected on top of the tip
+        if (chainActive.Tip() && pblock->hashPrevBlock == chainActive.Tip()->GetBlockHash())
+            PrefetchBlockInputs(pblock->GetHash(), CDiskBlockPos(), pblock);
+
         // Store to disk
         CBlockIndex *pindex = NULL;
         bool ret = AcceptBlock(*pblock, state, &pindex, fRequested, dbp);
@@ -4778,6 +5067,33 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Check the Equihash solutions of unknown headers on the check
+        // queue threads, without holding cs_main. Only a continuous run
+        // starting from a known block is checked this way, so that a peer
+        // can't have us verify solutions of headers that would be rejected
+        // anyway. Headers that fail, or that follow a break, are checked
+        // again in order below, so they are rejected exactly as before.
+        std::vector<char> vSolutionValid(nCount, false);
+        if (nScriptCheckThreads && nCount > 1) {
+            std::vector<CEquihashCheck> vChecks;
+            {
+                LOCK(cs_main);
+                if (mapBlockIndex.count(headers[0].hashPrevBlock)) {
+                    uint256 hashPrev = headers[0].hashPrevBlock;
+                    for (unsigned int n = 0; n < nCount; n++) {
+                        if (headers[n].hashPrevBlock != hashPrev)
+                            break;
+                        hashPrev = headers[n].GetHash();
+                        if (!mapBlockIndex.count(hashPrev))
+                            vChecks.push_back(CEquihashCheck(headers[n], vSolutionValid[n]));
+                    }
+                }
+            }
+            CCheckQueueControl<CEquihashCheck> control(&equihashcheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        }
+
         LOCK(cs_main);
 
         if (nCount == 0) {
@@ -4786,13 +5102,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
         CBlockIndex *pindexLast = NULL;
-        BOOST_FOREACH(const CBlockHeader& header, headers) {
+        for (unsigned int n = 0; n < nCount; n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
-            if (!AcceptBlockHeader(header, state, &pindexLast)) {
+            if (!AcceptBlockHeader(header, state, &pindexLast, !vSolutionValid[n])) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
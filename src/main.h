@@ -41,6 +41,8 @@ class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
 class CInv;
+class CEquihashCheck;
+class CPourCheck;
 class CScriptCheck;
 class CValidationInterface;
 class CValidationState;
@@ -75,6 +77,12 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -pourcheckthreads default (number of pour-checking threads, 0 = auto) */
+static const int DEFAULT_POURCHECK_THREADS = 0;
+/** -prefetchthreads default (number of threads looking up block inputs ahead of ConnectBlock) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Number of blocks ahead of the tip whose inputs are looked up while the tip connects */
+static const unsigned int PREFETCH_BLOCKS_AHEAD = 8;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -112,6 +120,8 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nPourCheckThreads;
+extern int nPrefetchThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
@@ -191,6 +201,12 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the Equihash solution checking thread */
+void ThreadEquihashCheck();
+/** Run an instance of the pour proof checking thread */
+void ThreadPourCheck();
+/** Run an instance of the block input prefetching thread */
+void ThreadCoinsPrefetch();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -380,6 +396,51 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the Equihash solution check of one block header,
+ * used to check the headers of a headers message in parallel. The result
+ * is written to *pfValid; it always returns true so that one bad header
+ * does not stop the checks of the others.
+ */
+class CEquihashCheck
+{
+private:
+    const CBlockHeader *pheader;
+    char *pfValid;
+
+public:
+    CEquihashCheck(): pheader(NULL), pfValid(NULL) {}
+    CEquihashCheck(const CBlockHeader& headerIn, char& fValidIn) :
+        pheader(&headerIn), pfValid(&fValidIn) { }
+
+    bool operator()();
+
+    void swap(CEquihashCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+/**
+ * Closure representing the zk-SNARK verification of a group of pours,
+ * which are checked together with ZCJoinSplit::verifyBatch().
+ */
+class CPourCheck
+{
+private:
+    std::vector<ZCJoinSplit::Statement> statements;
+
+public:
+    CPourCheck() {}
+    CPourCheck(std::vector<ZCJoinSplit::Statement>& statementsIn) { statements.swap(statementsIn); }
+
+    bool operator()();
+
+    void swap(CPourCheck &check) {
+        statements.swap(check.statements);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -395,11 +456,12 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
  *  of problems. Note that in any case, coins may be modified. */
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false);
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins.
+ *  In case pOldTree is provided, it receives the commitment tree the block was appended to. */
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false, ZCIncrementalMerkleTree* pOldTree = NULL);
 
 /** Context-independent validity checks */
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true, bool fCheckSolution = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
 /** Context-dependent validity checks */
@@ -411,7 +473,7 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
 
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex **pindex, bool fRequested, CDiskBlockPos* dbp);
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL);
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool fCheckSolution = true);
 
 
 
@@ -492,6 +554,13 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/**
+ * Global variable that points to the cache under pcoinsTip that the prefetching
+ * threads fill, or NULL with -prefetchthreads=0. Unlike pcoinsTip it can be read
+ * without cs_main.
+ */
+extern CCoinsViewShardedCache *pcoinsShard;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
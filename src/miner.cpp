@@ -24,6 +24,8 @@
 
 #include "sodium.h"
 
+#include <atomic>
+
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 
@@ -394,6 +396,28 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
 // Internal miner
 //
 
+// Bumped by the first miner thread to see that the tip or the mempool
+// changed; every thread drops its template when it no longer matches.
+static std::atomic<unsigned int> nMinerWorkId(0);
+
+// Solver runs and solutions since the miner threads were last started
+static std::atomic<uint64_t> nMinerSolverRuns(0);
+static std::atomic<uint64_t> nMinerSolutions(0);
+static std::atomic<int64_t> nMinerStartMicros(0);
+
+void GetMinerRates(double& dSolverRunsPerSec, double& dSolutionsPerSec)
+{
+    dSolverRunsPerSec = dSolutionsPerSec = 0;
+    int64_t nStartMicros = nMinerStartMicros;
+    if (nStartMicros == 0)
+        return;
+    double dSeconds = (GetTimeMicros() - nStartMicros) * 0.000001;
+    if (dSeconds <= 0)
+        return;
+    dSolverRunsPerSec = nMinerSolverRuns / dSeconds;
+    dSolutionsPerSec = nMinerSolutions / dSeconds;
+}
+
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey)
 {
     CPubKey pubkey;
@@ -433,7 +457,16 @@ static bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& rese
     return true;
 }
 
-void static BitcoinMiner(CWallet *pwallet)
+std::string DefaultEquihashSolver()
+{
+    if (GetArg("-equihashmaxmem", 0) > 0)
+        return "bounded";
+    if (GetArg("-equihashthreads", 1) > 1)
+        return "parallel";
+    return "optimised";
+}
+
+void static BitcoinMiner(CWallet *pwallet, int nThreadIndex)
 {
     LogPrintf("ZcashMiner started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
@@ -447,6 +480,18 @@ void static BitcoinMiner(CWallet *pwallet)
     unsigned int n = chainparams.EquihashN();
     unsigned int k = chainparams.EquihashK();
 
+    // Solver settings; without -equihashsolver the choice follows them
+    EhSolverParams solverParams;
+    solverParams.nThreads = std::max<int64_t>(GetArg("-equihashthreads", 1), 1);
+    solverParams.nMemoryBudget = std::max<int64_t>(GetArg("-equihashmaxmem", 0), 0) << 20;
+    std::string strSolver = GetArg("-equihashsolver", DefaultEquihashSolver());
+    CEquihashSolver* solver = EhGetSolver(strSolver);
+    if (!solver) {
+        LogPrintf("Error in ZcashMiner: Unknown Equihash solver %s\n", strSolver);
+        return;
+    }
+    LogPrintf("ZcashMiner using Equihash solver %s\n", solver->GetName());
+
     try {
         while (true) {
             if (chainparams.MiningRequiresPeers()) {
@@ -467,6 +512,7 @@ void static BitcoinMiner(CWallet *pwallet)
             //
             // Create new block
             //
+            unsigned int nWorkId = nMinerWorkId;
             unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
             CBlockIndex* pindexPrev = chainActive.Tip();
 
@@ -488,82 +534,87 @@ void static BitcoinMiner(CWallet *pwallet)
             int64_t nStart = GetTime();
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
 
-            while (true) {
-                // Hash state
-                crypto_generichash_blake2b_state state;
-                EhInitialiseState(n, k, state);
-
-                // I = the block header minus nonce and solution.
-                CEquihashInput I{*pblock};
-                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                ss << I;
+            // Each thread owns the nonces whose top 32 bits are its index
+            arith_uint256 nNonceStart = arith_uint256(nThreadIndex) << 224;
+            pblock->nNonce = ArithToUint256(nNonceStart);
 
-                // H(I||...
-                crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+            // H(I||... is the same for every nonce until nTime changes
+            eh_HashState state;
+            InitEquihashHeaderState(pblock, chainparams, state);
 
-                // Find valid nonce
-                while (true)
-                {
-                    // H(I||V||...
-                    crypto_generichash_blake2b_state curr_state;
-                    curr_state = state;
-                    crypto_generichash_blake2b_update(&curr_state,
-                                                      pblock->nNonce.begin(),
-                                                      pblock->nNonce.size());
-
-                    // (x_1, x_2, ...) = A(I, V, n, k)
-                    LogPrint("pow", "Running Equihash solver with nNonce = %s\n",
-                             pblock->nNonce.ToString());
-                    std::set<std::vector<unsigned int>> solns;
-                    EhOptimisedSolve(n, k, curr_state, solns);
-                    LogPrint("pow", "Solutions: %d\n", solns.size());
-
-                    // Write the solution to the hash and compute the result.
-                    for (auto soln : solns) {
-                        pblock->nSolution = soln;
-
-                        if (UintToArith256(pblock->GetHash()) > hashTarget) {
-                            continue;
-                        }
+            // Find valid nonce
+            while (true)
+            {
+                // H(I||V||...
+                eh_HashState curr_state;
+                curr_state = state;
+                crypto_generichash_blake2b_update(&curr_state,
+                                                  pblock->nNonce.begin(),
+                                                  pblock->nNonce.size());
+
+                // (x_1, x_2, ...) = A(I, V, n, k)
+                LogPrint("pow", "Running Equihash solver with nNonce = %s\n",
+                         pblock->nNonce.ToString());
+                std::set<std::vector<unsigned int>> solns = solver->Solve(n, k, curr_state, solverParams);
+                LogPrint("pow", "Solutions: %d\n", solns.size());
+                nMinerSolverRuns++;
+                nMinerSolutions += solns.size();
+
+                // Write the solution to the hash and compute the result.
+                bool fFound = false;
+                for (auto soln : solns) {
+                    pblock->nSolution = soln;
+
+                    if (UintToArith256(pblock->GetHash()) > hashTarget) {
+                        continue;
+                    }
 
-                        // Found a solution
-                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        LogPrintf("ZcashMiner:\n");
-                        LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", pblock->GetHash().GetHex(), hashTarget.GetHex());
-                        ProcessBlockFound(pblock, *pwallet, reservekey);
-                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                    // Found a solution
+                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                    LogPrintf("ZcashMiner:\n");
+                    LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", pblock->GetHash().GetHex(), hashTarget.GetHex());
+                    ProcessBlockFound(pblock, *pwallet, reservekey);
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
-                        // In regression test mode, stop mining after a block is found.
-                        if (chainparams.MineBlocksOnDemand())
-                            throw boost::thread_interrupted();
+                    // In regression test mode, stop mining after a block is found.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
 
-                        goto updateblock;
-                    }
-                    pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
-                    if ((UintToArith256(pblock->nNonce) & 0x1) == 0)
-                        break;
+                    fFound = true;
+                    break;
                 }
+                pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
 
-updateblock:
                 // Check for stop or if block needs to be rebuilt
                 boost::this_thread::interruption_point();
+                if (fFound || nMinerWorkId != nWorkId)
+                    break;
                 // Regtest mode doesn't require peers
                 if (vNodes.empty() && chainparams.MiningRequiresPeers())
                     break;
-                if (UintToArith256(pblock->nNonce) >= 0xffff)
-                    break;
-                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
+                if (UintToArith256(pblock->nNonce) - nNonceStart >= 0xffff)
                     break;
-                if (pindexPrev != chainActive.Tip())
+                if ((mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60) ||
+                    pindexPrev != chainActive.Tip()) {
+                    // The other threads are working from the same tip and
+                    // mempool, so move them all on to new templates
+                    unsigned int nExpected = nWorkId;
+                    nMinerWorkId.compare_exchange_strong(nExpected, nWorkId + 1);
                     break;
+                }
 
-                // Update nTime every few seconds
+                // Update nTime every few seconds, and rebuild the hash
+                // state only if the header changed
+                uint32_t nTimeOld = pblock->nTime;
+                uint32_t nBitsOld = pblock->nBits;
                 UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
                 if (chainparams.GetConsensus().fPowAllowMinDifficultyBlocks)
                 {
                     // Changing pblock->nTime can change work required on testnet:
                     hashTarget.SetCompact(pblock->nBits);
                 }
+                if (pblock->nTime != nTimeOld || pblock->nBits != nBitsOld)
+                    InitEquihashHeaderState(pblock, chainparams, state);
             }
         }
     }
@@ -598,12 +649,16 @@ void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads)
         minerThreads = NULL;
     }
 
+    nMinerStartMicros = 0;
     if (nThreads == 0 || !fGenerate)
         return;
 
+    nMinerSolverRuns = 0;
+    nMinerSolutions = 0;
+    nMinerStartMicros = GetTimeMicros();
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, pwallet));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, pwallet, i));
 }
 
 #endif // ENABLE_WALLET
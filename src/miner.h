@@ -9,6 +9,7 @@
 #include "primitives/block.h"
 
 #include <stdint.h>
+#include <string>
 
 class CBlockIndex;
 class CReserveKey;
@@ -23,8 +24,12 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+/** The Equihash solver used when -equihashsolver is not set */
+std::string DefaultEquihashSolver();
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
+/** Equihash solver runs and solutions per second since the miner threads started */
+void GetMinerRates(double& dSolverRunsPerSec, double& dSolutionsPerSec);
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey);
@@ -0,0 +1,92 @@
+// Copyright (c) 2016 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pourcache.h"
+
+#include "hash.h"
+#include "random.h"
+#include "util.h"
+
+#include <set>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/**
+ * Cache of pours whose zk-SNARK verified, to avoid doing the pairings
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ */
+class CPourCache
+{
+private:
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_pourcache;
+
+public:
+    bool Get(const uint256& key)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_pourcache);
+        return setValid.count(key) != 0;
+    }
+
+    void Set(const uint256& key)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxpourcachesize", DEFAULT_MAX_POUR_CACHE_SIZE);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_pourcache);
+
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize)
+        {
+            // Evict a random entry, for the same reason as the
+            // signature cache does.
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(key);
+    }
+};
+
+CPourCache pourCache;
+
+}
+
+uint256 GetPourCacheKey(const CPourTx& pour, const uint256& pubKeyHash)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pour.proof;
+    ss << pour.anchor;
+    ss << pour.serials;
+    ss << pour.commitments;
+    ss << pour.macs;
+    ss << pour.randomSeed;
+    ss << pour.vpub_old;
+    ss << pour.vpub_new;
+    ss << pubKeyHash;
+    return ss.GetHash();
+}
+
+bool IsPourVerificationCached(const uint256& key)
+{
+    return pourCache.Get(key);
+}
+
+bool VerifyPourCached(const CPourTx& pour, ZCJoinSplit& params, const uint256& pubKeyHash, bool store)
+{
+    uint256 key = GetPourCacheKey(pour, pubKeyHash);
+    if (pourCache.Get(key))
+        return true;
+
+    if (!pour.Verify(params, pubKeyHash))
+        return false;
+
+    if (store)
+        pourCache.Set(key);
+    return true;
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2016 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POURCACHE_H
+#define BITCOIN_POURCACHE_H
+
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+/** Default for -maxpourcachesize, the number of verified pours remembered */
+static const unsigned int DEFAULT_MAX_POUR_CACHE_SIZE = 10000;
+
+/**
+ * Hash committing to a pour's proof and public inputs together with the
+ * transaction's joinSplitPubKey, under which it is stored in the cache.
+ */
+uint256 GetPourCacheKey(const CPourTx& pour, const uint256& pubKeyHash);
+
+/** Whether the pour's proof has already been verified */
+bool IsPourVerificationCached(const uint256& key);
+
+/**
+ * Verifies the pour's proof unless it is in the cache. Successful
+ * verifications are remembered if store is true.
+ */
+bool VerifyPourCached(const CPourTx& pour, ZCJoinSplit& params, const uint256& pubKeyHash, bool store = true);
+
+#endif // BITCOIN_POURCACHE_H
@@ -86,24 +86,66 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
     return bnNew.GetCompact();
 }
 
-bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+/**
+ * A serialization stream that feeds its output into a BLAKE2b state, so
+ * headers can be hashed without building a CDataStream.
+ */
+class CEquihashStateWriter
+{
+private:
+    eh_HashState& state;
+
+public:
+    int nType;
+    int nVersion;
+
+    CEquihashStateWriter(eh_HashState& stateIn, int nTypeIn, int nVersionIn) :
+        state(stateIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CEquihashStateWriter& write(const char *pch, size_t size) {
+        crypto_generichash_blake2b_update(&state, (const unsigned char*)pch, size);
+        return (*this);
+    }
+
+    template<typename T>
+    CEquihashStateWriter& operator<<(const T& obj) {
+        // Serialize to this stream
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+void InitEquihashHeaderState(const CBlockHeader *pblock, const CChainParams& params, eh_HashState& state)
 {
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
 
     // Hash state
-    crypto_generichash_blake2b_state state;
     EhInitialiseState(n, k, state);
 
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
-    // I||V
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    // H(I||...
+    CEquihashStateWriter ss(state, SER_NETWORK, PROTOCOL_VERSION);
     ss << I;
-    ss << pblock->nNonce;
+}
+
+bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+{
+    eh_HashState state;
+    InitEquihashHeaderState(pblock, params, state);
+    return CheckEquihashSolution(pblock, params, state);
+}
+
+bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params, const eh_HashState& prefixState)
+{
+    unsigned int n = params.EquihashN();
+    unsigned int k = params.EquihashK();
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    eh_HashState state;
+    state = prefixState;
+    crypto_generichash_blake2b_update(&state, pblock->nNonce.begin(), pblock->nNonce.size());
 
     bool isValid;
     EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
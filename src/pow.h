@@ -7,6 +7,7 @@
 #define BITCOIN_POW_H
 
 #include "consensus/params.h"
+#include "crypto/equihash.h"
 
 #include <stdint.h>
 
@@ -19,8 +20,12 @@ class arith_uint256;
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
 
+/** Initialise an Equihash hash state and absorb I, the block header minus nonce and solution */
+void InitEquihashHeaderState(const CBlockHeader *pblock, const CChainParams&, eh_HashState& state);
 /** Check whether the Equihash solution in a block header is valid */
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&);
+/** As above, continuing from a state set up by InitEquihashHeaderState for the same I */
+bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&, const eh_HashState& prefixState);
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
@@ -54,6 +54,21 @@ bool CPourTx::Verify(
     );
 }
 
+ZCJoinSplit::Statement CPourTx::GetStatement(const uint256& pubKeyHash) const
+{
+    ZCJoinSplit::Statement st;
+    st.proof = proof;
+    st.pubKeyHash = pubKeyHash;
+    st.randomSeed = randomSeed;
+    st.macs = macs;
+    st.nullifiers = serials;
+    st.commitments = commitments;
+    st.vpub_old = vpub_old;
+    st.vpub_new = vpub_new;
+    st.rt = anchor;
+    return st;
+}
+
 uint256 CPourTx::h_sig(ZCJoinSplit& params, const uint256& pubKeyHash) const
 {
     return params.h_sig(randomSeed, serials, pubKeyHash);
@@ -79,6 +79,9 @@ public:
     // Verifies that the pour proof is correct.
     bool Verify(ZCJoinSplit& params, const uint256& pubKeyHash) const;
 
+    // Returns the proof and public inputs for ZCJoinSplit::verifyBatch()
+    ZCJoinSplit::Statement GetStatement(const uint256& pubKeyHash) const;
+
     // Returns the calculated h_sig
     uint256 h_sig(ZCJoinSplit& params, const uint256& pubKeyHash) const;
 
@@ -95,6 +95,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "zcrawpour", 2 },
     { "zcrawpour", 3 },
     { "zcrawpour", 4 },
+    { "zcrawpourasync", 1 },
+    { "zcrawpourasync", 2 },
+    { "zcrawpourasync", 3 },
+    { "zcrawpourasync", 4 },
+    { "zcrawscan", 1 },
     { "zcbenchmark", 1 }
 };
 
@@ -276,6 +276,8 @@ Value getmininginfo(const Array& params, bool fHelp)
             "  \"errors\": \"...\"          (string) Current errors\n"
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
             "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see getgenerate or setgenerate calls)\n"
+            "  \"solverrunspersec\": x.xxx  (numeric) Equihash solver runs (nonces) per second of the internal miner\n"
+            "  \"solutionspersec\": x.xxx   (numeric) Equihash solutions per second found by the internal miner\n"
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
@@ -301,11 +303,57 @@ Value getmininginfo(const Array& params, bool fHelp)
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
 #ifdef ENABLE_WALLET
     obj.push_back(Pair("generate",         getgenerate(params, false)));
+    double dSolverRunsPerSec, dSolutionsPerSec;
+    GetMinerRates(dSolverRunsPerSec, dSolutionsPerSec);
+    obj.push_back(Pair("solverrunspersec", dSolverRunsPerSec));
+    obj.push_back(Pair("solutionspersec",  dSolutionsPerSec));
 #endif
     return obj;
 }
 
 
+Value getequihashsolvers(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getequihashsolvers\n"
+            "\nReturns the Equihash solvers that can be selected with -equihashsolver, and how each has performed so far."
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",          (string) The solver name\n"
+            "    \"description\": \"xxxx\",   (string) What the solver does\n"
+            "    \"selected\": true|false,    (boolean) If coin generation uses this solver\n"
+            "    \"runs\": n,                 (numeric) The number of nonces solved\n"
+            "    \"solutions\": n,            (numeric) The number of solutions found\n"
+            "    \"seconds\": x.xxx,          (numeric) The time spent solving\n"
+            "    \"solutionspersec\": x.xxx   (numeric) Solutions found per second of solving\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getequihashsolvers", "")
+            + HelpExampleRpc("getequihashsolvers", "")
+        );
+
+    Array ret;
+    BOOST_FOREACH(const CEquihashSolver* solver, EhListSolvers()) {
+        Object obj;
+        obj.push_back(Pair("name",            solver->GetName()));
+        obj.push_back(Pair("description",     solver->GetDescription()));
+#ifdef ENABLE_WALLET
+        obj.push_back(Pair("selected",        solver->GetName() == GetArg("-equihashsolver", DefaultEquihashSolver())));
+#endif
+        obj.push_back(Pair("runs",            solver->GetRuns()));
+        obj.push_back(Pair("solutions",       solver->GetSolutions()));
+        obj.push_back(Pair("seconds",         solver->GetSeconds()));
+        obj.push_back(Pair("solutionspersec", solver->GetSolutionsPerSecond()));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+
 // NOTE: Unlike wallet RPC (which use BTC values), mining RPCs follow GBT (BIP 22) in using satoshi amounts
 Value prioritisetransaction(const Array& params, bool fHelp)
 {
@@ -300,6 +300,7 @@ static const CRPCCommand vRPCCommands[] =
 
     /* Mining */
     { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
+    { "mining",             "getequihashsolvers",     &getequihashsolvers,     true  },
     { "mining",             "getmininginfo",          &getmininginfo,          true  },
     { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
@@ -379,7 +380,10 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "zcbenchmark",            &zc_benchmark,           true  },
     { "wallet",             "zcrawkeygen",            &zc_raw_keygen,          true  },
     { "wallet",             "zcrawpour",              &zc_raw_pour,            true  },
-    { "wallet",             "zcrawreceive",           &zc_raw_receive,         true  }
+    { "wallet",             "zcrawpourasync",         &zc_raw_pour_async,      true  },
+    { "wallet",             "zcrawpourstatus",        &zc_raw_pour_status,     true  },
+    { "wallet",             "zcrawreceive",           &zc_raw_receive,         true  },
+    { "wallet",             "zcrawscan",              &zc_raw_scan,            true  }
 #endif // ENABLE_WALLET
 };
 
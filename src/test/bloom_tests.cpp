@@ -537,4 +537,39 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blocked_bloom)
+{
+    // 10,000 keys, ~0.1% false positive rate when full:
+    CBlockedBloomFilter bb(10000);
+
+    std::vector<uint256> data;
+    for (int i = 0; i < 10000; i++) {
+        data.push_back(GetRandHash());
+        bb.insert(data.back());
+    }
+    BOOST_CHECK_EQUAL(bb.size(), 10000U);
+    BOOST_CHECK_EQUAL(bb.capacity(), 10000U);
+
+    // No false negatives:
+    for (unsigned int i = 0; i < data.size(); i++) {
+        BOOST_CHECK(bb.contains(data[i]));
+    }
+
+    // So we should get about 100 hits testing 100,000 random keys:
+    unsigned int nHits = 0;
+    for (int i = 0; i < 100000; i++) {
+        if (bb.contains(GetRandHash()))
+            ++nHits;
+    }
+    BOOST_TEST_MESSAGE("BlockedBloomFilter got " << nHits << " false positives (~100 expected)");
+
+    // Insanely unlikely to get a fp count outside this range:
+    BOOST_CHECK(nHits > 25);
+    BOOST_CHECK(nHits < 250);
+
+    bb.clear();
+    BOOST_CHECK_EQUAL(bb.size(), 0U);
+    BOOST_CHECK(!bb.contains(data[0]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "coins.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "test/test_bitcoin.h"
 
@@ -11,6 +12,7 @@
 #include <map>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include "zcash/IncrementalMerkleTree.hpp"
 
 namespace
@@ -133,7 +135,9 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t ret = memusage::DynamicUsage(cacheCoins) +
+                     memusage::DynamicUsage(cacheAnchors) +
+                     memusage::DynamicUsage(cacheSerials);
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
             ret += memusage::DynamicUsage(it->second.coins);
         }
@@ -142,6 +146,18 @@ public:
 
 };
 
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest(size_t nCacheSize) : CCoinsViewDB(nCacheSize, true) {}
+
+    // Whether a checkpoint tree is stored under the root (DB_ANCHOR_CHECKPOINT)
+    bool HaveCheckpoint(const uint256 &rt) const
+    {
+        return db.Exists(std::make_pair('K', rt));
+    }
+};
+
 }
 
 uint256 appendRandomCommitment(ZCIncrementalMerkleTree &tree)
@@ -359,6 +375,181 @@ BOOST_AUTO_TEST_CASE(anchors_test)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(anchors_db_test, TestingSetup)
+{
+    CCoinsViewDBTest base(1 << 20);
+    std::vector<uint256> roots;
+    BOOST_CHECK(base.HaveCurrentAnchorFormat());
+
+    {
+        // Enough anchors for a few checkpoints, flushed in uneven batches
+        CCoinsViewCache cache(&base);
+        ZCIncrementalMerkleTree tree;
+        for (unsigned int i = 0; i < 3 * nAnchorCheckpointInterval; i++) {
+            appendRandomCommitment(tree);
+            cache.PushAnchor(tree);
+            roots.push_back(tree.root());
+            if (i % 7 == 0) {
+                BOOST_CHECK(cache.Flush());
+            }
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    for (size_t i = 0; i < roots.size(); i++) {
+        ZCIncrementalMerkleTree tree;
+        BOOST_CHECK(base.HaveAnchor(roots[i]));
+        BOOST_CHECK(base.GetAnchorAt(roots[i], tree));
+        BOOST_CHECK(tree.root() == roots[i]);
+    }
+
+    {
+        // Disconnect the last few
+        CCoinsViewCache cache(&base);
+        for (size_t i = roots.size() - 1; i >= roots.size() - 5; i--) {
+            cache.PopAnchor(roots[i - 1]);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    BOOST_CHECK(base.GetBestAnchor() == roots[roots.size() - 6]);
+    for (size_t i = 0; i < roots.size(); i++) {
+        ZCIncrementalMerkleTree tree;
+        bool fConnected = i < roots.size() - 5;
+        BOOST_CHECK(base.HaveAnchor(roots[i]) == fConnected);
+        BOOST_CHECK(base.GetAnchorAt(roots[i], tree) == fConnected);
+    }
+    BOOST_CHECK(base.HaveCheckpoint(roots[2 * nAnchorCheckpointInterval]));
+
+    // Disconnect past the last checkpoint, which goes with its anchor
+    size_t nFork = 2 * nAnchorCheckpointInterval - 10;
+    {
+        CCoinsViewCache cache(&base);
+        for (size_t i = roots.size() - 6; i > nFork; i--) {
+            cache.PopAnchor(roots[i - 1]);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(base.HaveCheckpoint(roots[0]));
+    BOOST_CHECK(base.HaveCheckpoint(roots[nAnchorCheckpointInterval]));
+    BOOST_CHECK(!base.HaveCheckpoint(roots[2 * nAnchorCheckpointInterval]));
+
+    // Another branch, which starts a checkpoint of its own
+    std::vector<uint256> branch;
+    {
+        CCoinsViewCache cache(&base);
+        ZCIncrementalMerkleTree tree;
+        BOOST_CHECK(cache.GetAnchorAt(roots[nFork], tree));
+        for (unsigned int i = 0; i < 50; i++) {
+            appendRandomCommitment(tree);
+            cache.PushAnchor(tree);
+            branch.push_back(tree.root());
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(base.HaveCheckpoint(branch[0]));
+    for (size_t i = 0; i <= nFork; i++) {
+        ZCIncrementalMerkleTree tree;
+        BOOST_CHECK(base.GetAnchorAt(roots[i], tree));
+        BOOST_CHECK(tree.root() == roots[i]);
+    }
+    for (size_t i = 0; i < branch.size(); i++) {
+        ZCIncrementalMerkleTree tree;
+        BOOST_CHECK(base.GetAnchorAt(branch[i], tree));
+        BOOST_CHECK(tree.root() == branch[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sharded_cache_test)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> txids(500), serials(500);
+    {
+        CCoinsViewCacheTest cache(&base);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            txids[i] = GetRandHash();
+            CCoinsModifier entry = cache.ModifyCoins(txids[i]);
+            entry->vout.resize(1);
+            entry->vout[0].nValue = i + 1;
+        }
+        for (unsigned int i = 0; i < serials.size(); i++) {
+            serials[i] = GetRandHash();
+            if (i % 2 == 0)
+                cache.SetSerial(serials[i], true);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsViewShardedCache sharded(&base);
+    size_t nEmptyUsage = sharded.DynamicMemoryUsage();
+
+    // Threads prefetching the same keys while others look them up
+    unsigned int nFailures = 0;
+    CCriticalSection csFailures;
+    boost::thread_group threads;
+    for (int t = 0; t < 4; t++) {
+        threads.create_thread([&, t]() {
+            for (int n = 0; n < 2; n++) {
+                for (unsigned int i = 0; i < txids.size(); i++) {
+                    unsigned int j = (i + t * 97) % txids.size();
+                    if (t % 2 == 0) {
+                        sharded.PrefetchCoins(txids[j]);
+                        sharded.PrefetchCoins(serials[j]);
+                        sharded.PrefetchSerial(serials[j]);
+                        continue;
+                    }
+                    CCoins coins;
+                    bool fOk = sharded.GetCoins(txids[j], coins) &&
+                               coins.vout.size() == 1 && coins.vout[0].nValue == j + 1 &&
+                               sharded.HaveCoins(txids[j]) &&
+                               sharded.GetSerial(serials[j]) == (j % 2 == 0) &&
+                               !sharded.HaveCoins(serials[j]);
+                    if (!fOk) {
+                        LOCK(csFailures);
+                        nFailures++;
+                    }
+                }
+            }
+        });
+    }
+    threads.join_all();
+    BOOST_CHECK_EQUAL(nFailures, 0U);
+
+    // Entries are handed over to the cache on top rather than kept twice
+    sharded.Clear();
+    BOOST_CHECK_EQUAL(sharded.DynamicMemoryUsage(), nEmptyUsage);
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        sharded.PrefetchCoins(txids[i]);
+        sharded.PrefetchSerial(serials[i]);
+    }
+    size_t nUsage = sharded.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nEmptyUsage);
+    {
+        CCoinsViewCacheTest cache(&sharded);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            const CCoins* coins = cache.AccessCoins(txids[i]);
+            BOOST_CHECK(coins && coins->vout[0].nValue == i + 1);
+        }
+        BOOST_CHECK(sharded.DynamicMemoryUsage() < nUsage);
+        for (unsigned int i = 0; i < serials.size(); i++) {
+            BOOST_CHECK(cache.GetSerial(serials[i]) == (i % 2 == 0));
+        }
+        BOOST_CHECK(sharded.DynamicMemoryUsage() < nUsage);
+
+        // Writes go through to the view below, and nothing stale is kept
+        sharded.PrefetchSerial(serials[1]);
+        sharded.PrefetchCoins(txids[1]);
+        cache.SetSerial(serials[1], true);
+        cache.ModifyCoins(txids[0])->Clear();
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(sharded.DynamicMemoryUsage(), nEmptyUsage);
+    BOOST_CHECK(base.GetSerial(serials[1]));
+    BOOST_CHECK(sharded.GetSerial(serials[1]));
+    BOOST_CHECK(!sharded.HaveCoins(txids[0]));
+    BOOST_CHECK(sharded.HaveCoins(txids[1]));
+}
+
 static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 
 // This is a large randomized insert/remove simulation test on a variable-size
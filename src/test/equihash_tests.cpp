@@ -66,6 +66,56 @@ void TestEquihashSolvers(unsigned int n, unsigned int k, const std::string &I, c
     BOOST_TEST_MESSAGE(strm.str());
     BOOST_CHECK(retOpt == solns);
     BOOST_CHECK(retOpt == ret);
+
+    // Using comparison sorts in the optimised solver should not change the result
+    std::set<std::vector<uint32_t>> retCmp;
+    EhOptimisedSolveSort(n, k, state, retCmp, EH_SORT_COMPARISON);
+    BOOST_TEST_MESSAGE("[Optimised, comparison sort] Number of solutions: " << retCmp.size());
+    BOOST_CHECK(retCmp == solns);
+    BOOST_CHECK(retCmp == ret);
+
+    // The parallel solver should have the exact same result
+    std::set<std::vector<uint32_t>> retPar;
+    EhParallelSolve(n, k, state, retPar, 4);
+    BOOST_TEST_MESSAGE("[Parallel] Number of solutions: " << retPar.size());
+    strm.str("");
+    PrintSolutions(strm, retPar);
+    BOOST_TEST_MESSAGE(strm.str());
+    BOOST_CHECK(retPar == solns);
+    BOOST_CHECK(retPar == ret);
+
+    // The index-pointer solver should have the exact same result
+    std::set<std::vector<uint32_t>> retIdx;
+    EhIndexedSolve(n, k, state, retIdx);
+    BOOST_TEST_MESSAGE("[Indexed] Number of solutions: " << retIdx.size());
+    strm.str("");
+    PrintSolutions(strm, retIdx);
+    BOOST_TEST_MESSAGE(strm.str());
+    BOOST_CHECK(retIdx == solns);
+    BOOST_CHECK(retIdx == ret);
+
+    // The memory-bounded solver should match with the smallest budget that
+    // keeps every row for these inputs: 640 slots per bucket, a little over
+    // the 608 the fullest of them needs...
+    size_t nMinMemory;
+    EhBoundedMinMemory(n, k, nMinMemory);
+    std::set<std::vector<uint32_t>> retBnd;
+    size_t nDropped;
+    EhBoundedSolve(n, k, state, retBnd, 640 * nMinMemory, nDropped);
+    BOOST_TEST_MESSAGE("[Bounded] Number of solutions: " << retBnd.size());
+    BOOST_CHECK(retBnd == solns);
+    BOOST_CHECK(nDropped == 0);
+
+    // ...and drop rows, keeping only valid solutions, when buckets are held
+    // to their average size
+    std::set<std::vector<uint32_t>> retSmall;
+    EhBoundedSolve(n, k, state, retSmall, 512 * nMinMemory, nDropped);
+    BOOST_TEST_MESSAGE("[Bounded, 512 slots] Number of solutions: " << retSmall.size() << ", rows dropped: " << nDropped);
+    BOOST_CHECK(nDropped > 0);
+    BOOST_CHECK(std::includes(solns.begin(), solns.end(), retSmall.begin(), retSmall.end()));
+
+    // Less than one slot per bucket is refused
+    BOOST_CHECK_THROW(EhBoundedSolve(n, k, state, retSmall, nMinMemory - 1, nDropped), std::runtime_error);
 }
 
 void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I, const arith_uint256 &nonce, std::vector<uint32_t> soln, bool expected) {
@@ -81,6 +131,11 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, soln, isValid);
     BOOST_CHECK(isValid == expected);
+
+    // The basic validator should agree
+    bool isValidBasic;
+    EhBasicIsValidSolution(n, k, state, soln, isValidBasic);
+    BOOST_CHECK(isValidBasic == expected);
 }
 
 BOOST_AUTO_TEST_CASE(solver_testvectors) {
@@ -114,6 +169,73 @@ BOOST_AUTO_TEST_CASE(solver_testvectors) {
                 });
 }
 
+BOOST_AUTO_TEST_CASE(hash_indices) {
+    // Cover every position of the index relative to the BLAKE2b blocks
+    std::vector<unsigned char> input(400);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = i * 7;
+    std::vector<eh_index> indices;
+    for (eh_index i = 0; i < 37; i++)
+        indices.push_back(i * 2654435761u);
+
+    for (size_t len = 0; len <= input.size(); len++) {
+        crypto_generichash_blake2b_state state;
+        EhInitialiseState(96, 5, state);
+        crypto_generichash_blake2b_update(&state, input.data(), len);
+
+        std::vector<unsigned char> batch(indices.size() * 12);
+        EhHashIndices(state, indices.data(), indices.size(), batch.data(), 12);
+        for (size_t i = 0; i < indices.size(); i++) {
+            crypto_generichash_blake2b_state curr_state;
+            curr_state = state;
+            unsigned char hash[12];
+            crypto_generichash_blake2b_update(&curr_state, (unsigned char*)&indices[i], sizeof(eh_index));
+            crypto_generichash_blake2b_final(&curr_state, hash, 12);
+            BOOST_CHECK(memcmp(hash, &batch[i * 12], 12) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hash_indices_layout) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && SODIUM_LIBRARY_VERSION_MAJOR == 9
+    // EhHashIndices falls back to libsodium's own calls if the BLAKE2b
+    // state isn't laid out as the AVX2 path expects; with the libsodium
+    // that path was written for, that would be a silent slowdown
+    BOOST_CHECK(EhHashIndicesAVX2Built());
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(solver_registry) {
+    // A registry of its own, so that nothing registered here or counted
+    // by the miner leaks between it and the rest of the process
+    CEquihashSolverRegistry registry;
+    std::vector<std::string> names;
+    for (const CEquihashSolver* solver : registry.List())
+        names.push_back(solver->GetName());
+    BOOST_CHECK(names == std::vector<std::string>({"basic", "bounded", "indexed", "optimised", "parallel"}));
+    BOOST_CHECK(registry.Get("nonexistent") == NULL);
+
+    // Names cannot be registered twice
+    auto none = [](unsigned int n, unsigned int k, const eh_HashState& base_state, const EhSolverParams& params) {
+        return std::set<std::vector<eh_index>>();
+    };
+    BOOST_CHECK(!registry.Add("optimised", "", none));
+    BOOST_CHECK(registry.Add("test-none", "Finds nothing", none));
+    BOOST_CHECK(registry.Get("test-none")->GetDescription() == "Finds nothing");
+    BOOST_CHECK(EhGetSolver("test-none") == NULL);
+
+    // Solving through the registry gives the solver's result and counts it
+    crypto_generichash_blake2b_state state;
+    EhInitialiseState(96, 5, state);
+    std::set<std::vector<eh_index>> solns;
+    EhOptimisedSolve(96, 5, state, solns);
+    CEquihashSolver* solver = registry.Get("optimised");
+    EhSolverParams params;
+    BOOST_CHECK(solver->Solve(96, 5, state, params) == solns);
+    BOOST_CHECK_EQUAL(solver->GetRuns(), 1);
+    BOOST_CHECK_EQUAL(solver->GetSolutions(), solns.size());
+}
+
 BOOST_AUTO_TEST_CASE(validator_testvectors) {
     // Original valid solution
     TestEquihashValidator(96, 5, "Equihash is an asymmetric PoW based on the Generalised Birthday problem.", 0,
@@ -55,7 +55,8 @@ TestingSetup::TestingSetup()
         mapArgs["-datadir"] = pathTemp.string();
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsShard = new CCoinsViewShardedCache(pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(pcoinsShard);
         InitBlockIndex();
 #ifdef ENABLE_WALLET
         bool fFirstRun;
@@ -66,6 +67,9 @@ TestingSetup::TestingSetup()
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        nPrefetchThreads = 2;
+        for (int i=0; i < nPrefetchThreads; i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
         RegisterNodeSignals(GetNodeSignals());
 }
 
@@ -81,6 +85,7 @@ TestingSetup::~TestingSetup()
 #endif
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete pcoinsShard;
         delete pcoinsdbview;
         delete pblocktree;
 #ifdef ENABLE_WALLET
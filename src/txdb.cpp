@@ -11,6 +11,7 @@
 #include "pow.h"
 #include "uint256.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -18,6 +19,7 @@
 using namespace std;
 
 static const char DB_ANCHOR = 'A';
+static const char DB_ANCHOR_CHECKPOINT = 'K';
 static const char DB_SERIAL = 's';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
@@ -30,17 +32,42 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
+//! Flag set in chainstates whose anchors are stored as CAnchorRecords
+static const std::string DB_FLAG_ANCHOR_DELTAS = "anchordeltas";
+
+
+/**
+ * How the tree of an anchor is stored under DB_ANCHOR: as the delta from
+ * a checkpoint tree, which is stored in full under DB_ANCHOR_CHECKPOINT.
+ * A checkpoint is stored under the root of the first anchor stored against
+ * it. Every later anchor stored against it extends that anchor's tree, so
+ * they are disconnected before it is, and the checkpoint is erased with it.
+ */
+class CAnchorRecord
+{
+public:
+    uint256 hashCheckpoint;
+    ZCIncrementalMerkleTreeDelta delta;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashCheckpoint);
+        READWRITE(delta);
+    }
+};
 
 void static BatchWriteAnchor(CLevelDBBatch &batch,
                              const uint256 &croot,
                              const ZCIncrementalMerkleTree &tree,
-                             const bool &entered)
+                             const uint256 &hashCheckpoint,
+                             const ZCIncrementalMerkleTree &checkpoint)
 {
-    if (!entered)
-        batch.Erase(make_pair(DB_ANCHOR, croot));
-    else {
-        batch.Write(make_pair(DB_ANCHOR, croot), tree);
-    }
+    CAnchorRecord record;
+    record.hashCheckpoint = hashCheckpoint;
+    record.delta = tree.delta(checkpoint);
+    batch.Write(make_pair(DB_ANCHOR, croot), record);
 }
 
 void static BatchWriteSerial(CLevelDBBatch &batch, const uint256 &serial, const bool &entered) {
@@ -65,7 +92,62 @@ void static BatchWriteHashBestAnchor(CLevelDBBatch &batch, const uint256 &hash)
     batch.Write(DB_BEST_ANCHOR, hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), serialFilter(nMinSerialFilterSize), fSerialFilter(false), nAnchorsSinceCheckpoint(0) {
+    // A new or wiped chainstate is written in the current format
+    if (GetBestBlock().IsNull())
+        db.Write(make_pair(DB_FLAG, DB_FLAG_ANCHOR_DELTAS), '1');
+
+    LoadSerialFilter();
+
+    // Carry on storing anchors against the checkpoint of the best one
+    CAnchorRecord record;
+    if (db.Read(make_pair(DB_ANCHOR, GetBestAnchor()), record) &&
+        db.Read(make_pair(DB_ANCHOR_CHECKPOINT, record.hashCheckpoint), treeAnchorCheckpoint)) {
+        hashAnchorCheckpoint = record.hashCheckpoint;
+    }
+}
+
+bool CCoinsViewDB::HaveCurrentAnchorFormat() const {
+    return db.Exists(make_pair(DB_FLAG, DB_FLAG_ANCHOR_DELTAS));
+}
+
+bool CCoinsViewDB::LoadSerialFilter() {
+    std::vector<uint256> serials;
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_SERIAL, uint256());
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_SERIAL)
+                break;
+            uint256 serial;
+            ssKey >> serial;
+            serials.push_back(serial);
+            pcursor->Next();
+        } catch (const std::exception& e) {
+            // Without the filter every serial is looked up in the database
+            fSerialFilter = false;
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    // Leave room for as many again before the next rebuild
+    serialFilter = CBlockedBloomFilter(std::max(nMinSerialFilterSize, 2 * serials.size()));
+    BOOST_FOREACH(const uint256& serial, serials) {
+        serialFilter.insert(serial);
+    }
+    fSerialFilter = true;
+
+    LogPrint("coindb", "Loaded %u serials into the serial filter\n", (unsigned int)serials.size());
+    return true;
 }
 
 
@@ -76,12 +158,37 @@ bool CCoinsViewDB::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree)
         return true;
     }
 
-    bool read = db.Read(make_pair(DB_ANCHOR, rt), tree);
+    CAnchorRecord record;
+    if (!db.Read(make_pair(DB_ANCHOR, rt), record))
+        return false;
+
+    ZCIncrementalMerkleTree checkpoint;
+    if (record.hashCheckpoint == hashAnchorCheckpoint) {
+        checkpoint = treeAnchorCheckpoint;
+    } else if (!db.Read(make_pair(DB_ANCHOR_CHECKPOINT, record.hashCheckpoint), checkpoint)) {
+        return error("%s: checkpoint %s of anchor %s not found", __func__, record.hashCheckpoint.GetHex(), rt.GetHex());
+    }
+
+    try {
+        tree = ZCIncrementalMerkleTree(checkpoint, record.delta);
+    } catch (const std::exception& e) {
+        return error("%s: anchor %s is corrupt - %s", __func__, rt.GetHex(), e.what());
+    }
 
-    return read;
+    return true;
+}
+
+bool CCoinsViewDB::HaveAnchor(const uint256 &rt) const {
+    if (rt == ZCIncrementalMerkleTree::empty_root())
+        return true;
+
+    return db.Exists(make_pair(DB_ANCHOR, rt));
 }
 
 bool CCoinsViewDB::GetSerial(const uint256 &serial) const {
+    if (fSerialFilter && !serialFilter.contains(serial))
+        return false;
+
     bool spent = false;
     bool read = db.Read(make_pair(DB_SERIAL, serial), spent);
 
@@ -128,18 +235,48 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         mapCoins.erase(itOld);
     }
 
-    for (CAnchorsMap::iterator it = mapAnchors.begin(); it != mapAnchors.end();) {
+    std::vector<CAnchorsMap::const_iterator> vNewAnchors;
+    for (CAnchorsMap::const_iterator it = mapAnchors.begin(); it != mapAnchors.end(); it++) {
         if (it->second.flags & CAnchorsCacheEntry::DIRTY) {
-            BatchWriteAnchor(batch, it->first, it->second.tree, it->second.entered);
+            if (it->second.entered) {
+                vNewAnchors.push_back(it);
+            } else {
+                batch.Erase(make_pair(DB_ANCHOR, it->first));
+                // If the anchor was a checkpoint, nothing else refers to it now
+                batch.Erase(make_pair(DB_ANCHOR_CHECKPOINT, it->first));
+                if (it->first == hashAnchorCheckpoint) {
+                    // The anchors that follow do not extend it, so start a new one
+                    hashAnchorCheckpoint.SetNull();
+                    treeAnchorCheckpoint = ZCIncrementalMerkleTree();
+                }
+            }
             // TODO: changed++?
         }
-        CAnchorsMap::iterator itOld = it++;
-        mapAnchors.erase(itOld);
     }
 
+    // Store the new anchors in the order their commitments were appended,
+    // starting a new checkpoint every nAnchorCheckpointInterval of them
+    std::sort(vNewAnchors.begin(), vNewAnchors.end(), [](CAnchorsMap::const_iterator a, CAnchorsMap::const_iterator b) {
+        return a->second.tree.size() < b->second.tree.size();
+    });
+    BOOST_FOREACH(CAnchorsMap::const_iterator it, vNewAnchors) {
+        if (hashAnchorCheckpoint.IsNull() || nAnchorsSinceCheckpoint >= nAnchorCheckpointInterval) {
+            hashAnchorCheckpoint = it->first;
+            treeAnchorCheckpoint = it->second.tree;
+            nAnchorsSinceCheckpoint = 0;
+            batch.Write(make_pair(DB_ANCHOR_CHECKPOINT, hashAnchorCheckpoint), treeAnchorCheckpoint);
+        }
+        BatchWriteAnchor(batch, it->first, it->second.tree, hashAnchorCheckpoint, treeAnchorCheckpoint);
+        nAnchorsSinceCheckpoint++;
+    }
+    mapAnchors.clear();
+
     for (CSerialsMap::iterator it = mapSerials.begin(); it != mapSerials.end();) {
         if (it->second.flags & CSerialsCacheEntry::DIRTY) {
             BatchWriteSerial(batch, it->first, it->second.entered);
+            // Serials that are erased stay in the filter until it is rebuilt
+            if (it->second.entered)
+                serialFilter.insert(it->first);
             // TODO: changed++?
         }
         CSerialsMap::iterator itOld = it++;
@@ -152,7 +289,12 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         BatchWriteHashBestAnchor(batch, hashAnchor);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+
+    if (serialFilter.size() > serialFilter.capacity())
+        LoadSerialFilter();
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "bloom.h"
 #include "coins.h"
 #include "leveldbwrapper.h"
 
@@ -25,16 +26,39 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! min. number of serials the serial filter is sized for
+static const size_t nMinSerialFilterSize = 100000;
+//! number of anchors stored as deltas against each full checkpoint tree
+static const unsigned int nAnchorCheckpointInterval = 100;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+    //! Holds every serial in the database, so that most lookups of serials
+    //! that are not spent never read it. Rebuilt from the database on startup.
+    CBlockedBloomFilter serialFilter;
+    //! Whether serialFilter could be loaded
+    bool fSerialFilter;
+
+    //! Refills serialFilter from the database, making it larger if needed
+    bool LoadSerialFilter();
+
+    //! The checkpoint tree that new anchors are stored against, and the
+    //! number of anchors stored against it since it was written
+    uint256 hashAnchorCheckpoint;
+    ZCIncrementalMerkleTree treeAnchorCheckpoint;
+    unsigned int nAnchorsSinceCheckpoint;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
+    //! Whether anchors are stored as deltas against checkpoint trees. Chainstates
+    //! written before that are not, and have to be rebuilt with -reindex.
+    bool HaveCurrentAnchorFormat() const;
+
     bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
+    bool HaveAnchor(const uint256 &rt) const;
     bool GetSerial(const uint256 &serial) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
@@ -320,8 +320,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             }
 
             // TODO: chained pours
-            ZCIncrementalMerkleTree tree;
-            assert(pcoins->GetAnchorAt(pour.anchor, tree));
+            assert(pcoins->HaveAnchor(pour.anchor));
         }
         if (fDependsWait)
             waitingOnDependants.push_back(&it->second);
@@ -8,7 +8,10 @@
 
 #include <boost/signals2/signal.hpp>
 
+#include "zcash/IncrementalMerkleTree.hpp"
+
 class CBlock;
+class CBlockIndex;
 struct CBlockLocator;
 class CTransaction;
 class CValidationInterface;
@@ -35,6 +38,7 @@ protected:
     virtual void Inventory(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
+    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const ZCIncrementalMerkleTree& tree, bool added) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -55,6 +59,8 @@ struct CMainSignals {
     boost::signals2::signal<void (int64_t nBestBlockTime)> Broadcast;
     /** Notifies listeners of a block validation result */
     boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
+    /** Notifies listeners of a block connected to (added) or disconnected from the tip, with the commitment tree before it was connected */
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *, const ZCIncrementalMerkleTree&, bool)> ChainTip;
 };
 
 CMainSignals& GetMainSignals();
@@ -0,0 +1,181 @@
+// Copyright (c) 2016 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/asyncpour.h"
+
+#include "random.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include "json/json_spirit_utils.h"
+
+using namespace json_spirit;
+
+namespace {
+
+const char* PourOperationStateName(PourOperationState state)
+{
+    switch (state) {
+    case POUR_QUEUED: return "queued";
+    case POUR_EXECUTING: return "executing";
+    case POUR_SUCCESS: return "success";
+    case POUR_FAILED: return "failed";
+    }
+    return "unknown";
+}
+
+CPourQueue pourqueue;
+
+}
+
+CPourOperation::CPourOperation(const PourOperationFn& fnIn) :
+    fn(fnIn), state(POUR_QUEUED), nCreated(GetTimeMicros()), nStarted(0), nFinished(0)
+{
+}
+
+Object CPourQueue::Status(const std::string& id, const CPourOperation& op) const
+{
+    int64_t nNow = GetTimeMicros();
+    Object status;
+    status.push_back(Pair("id", id));
+    status.push_back(Pair("status", PourOperationStateName(op.state)));
+    if (op.state == POUR_QUEUED) {
+        for (size_t i = 0; i < queue.size(); i++) {
+            if (queue[i] == id) {
+                status.push_back(Pair("position", (int)i));
+                break;
+            }
+        }
+        status.push_back(Pair("waitingtime", (nNow - op.nCreated) * 0.000001));
+    } else {
+        status.push_back(Pair("waitingtime", (op.nStarted - op.nCreated) * 0.000001));
+        int64_t nEnd = op.state == POUR_EXECUTING ? nNow : op.nFinished;
+        status.push_back(Pair("runningtime", (nEnd - op.nStarted) * 0.000001));
+    }
+    if (op.state == POUR_SUCCESS)
+        status.push_back(Pair("result", op.result));
+    if (op.state == POUR_FAILED)
+        status.push_back(Pair("error", op.strError));
+    return status;
+}
+
+// Drops the oldest finished operations once there are too many to keep
+void CPourQueue::Prune()
+{
+    std::list<std::string>::iterator it = listOperations.begin();
+    while (nFinished > MAX_FINISHED_POUR_OPERATIONS && it != listOperations.end()) {
+        std::map<std::string, CPourOperation>::iterator mi = mapOperations.find(*it);
+        if (mi->second.state == POUR_SUCCESS || mi->second.state == POUR_FAILED) {
+            mapOperations.erase(mi);
+            it = listOperations.erase(it);
+            nFinished--;
+        } else {
+            it++;
+        }
+    }
+}
+
+std::string CPourQueue::Submit(const PourOperationFn& fn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (queue.size() >= (size_t)GetArg("-maxpourqueue", DEFAULT_MAX_POUR_QUEUE))
+        return "";
+    std::string id = "opid-" + GetRandHash().GetHex();
+    mapOperations.insert(std::make_pair(id, CPourOperation(fn)));
+    listOperations.push_back(id);
+    queue.push_back(id);
+    condWorker.notify_one();
+    return id;
+}
+
+bool CPourQueue::GetStatus(const std::string& id, Object& status)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::map<std::string, CPourOperation>::const_iterator mi = mapOperations.find(id);
+    if (mi == mapOperations.end())
+        return false;
+    status = Status(id, mi->second);
+    return true;
+}
+
+Array CPourQueue::GetStatuses()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    Array statuses;
+    BOOST_FOREACH(const std::string& id, listOperations)
+        statuses.push_back(Status(id, mapOperations.find(id)->second));
+    return statuses;
+}
+
+void CPourQueue::Loop()
+{
+    while (true) {
+        std::string id;
+        PourOperationFn fn;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                condWorker.wait(lock); // interruption point
+            id = queue.front();
+            queue.pop_front();
+            CPourOperation& op = mapOperations.find(id)->second;
+            op.state = POUR_EXECUTING;
+            op.nStarted = GetTimeMicros();
+            fn.swap(op.fn);
+        }
+
+        Object result;
+        std::string strError;
+        bool fSuccess = false;
+        try {
+            result = fn();
+            fSuccess = true;
+        } catch (const Object& objError) {
+            // JSONRPCError
+            strError = find_value(objError, "message").get_str();
+        } catch (const boost::thread_interrupted&) {
+            throw;
+        } catch (const std::exception& e) {
+            strError = e.what();
+        } catch (...) {
+            strError = "unknown error";
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            CPourOperation& op = mapOperations.find(id)->second;
+            op.state = fSuccess ? POUR_SUCCESS : POUR_FAILED;
+            op.nFinished = GetTimeMicros();
+            op.result = result;
+            op.strError = strError;
+            nFinished++;
+            Prune();
+        }
+        LogPrint("bench", "pour operation %s %s\n", id, fSuccess ? "succeeded" : "failed: " + strError);
+    }
+}
+
+std::string SubmitPourOperation(const PourOperationFn& fn)
+{
+    return pourqueue.Submit(fn);
+}
+
+bool GetPourOperationStatus(const std::string& id, Object& status)
+{
+    return pourqueue.GetStatus(id, status);
+}
+
+Array GetPourOperationStatuses()
+{
+    return pourqueue.GetStatuses();
+}
+
+void ThreadPourWorker()
+{
+    RenameThread("zcash-pourwork");
+    pourqueue.Loop();
+}
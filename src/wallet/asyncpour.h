@@ -0,0 +1,100 @@
+// Copyright (c) 2016 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_ASYNCPOUR_H
+#define BITCOIN_WALLET_ASYNCPOUR_H
+
+#include "json/json_spirit_value.h"
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Default for -pourworkers, the number of threads creating pour proofs */
+static const int DEFAULT_POUR_WORKERS = 1;
+/** Default for -maxpourqueue, the number of pours that may wait for a worker */
+static const unsigned int DEFAULT_MAX_POUR_QUEUE = 100;
+/** Finished operations kept for zcrawpourstatus before the oldest are dropped */
+static const unsigned int MAX_FINISHED_POUR_OPERATIONS = 1000;
+
+/**
+ * Work of one queued pour. It runs on a worker thread without any locks
+ * held and returns the RPC result, or throws to fail the operation.
+ */
+typedef std::function<json_spirit::Object()> PourOperationFn;
+
+enum PourOperationState {
+    POUR_QUEUED,
+    POUR_EXECUTING,
+    POUR_SUCCESS,
+    POUR_FAILED
+};
+
+struct CPourOperation
+{
+    PourOperationFn fn;
+    PourOperationState state;
+    int64_t nCreated;
+    int64_t nStarted;
+    int64_t nFinished;
+    json_spirit::Object result;
+    std::string strError;
+
+    CPourOperation(const PourOperationFn& fnIn);
+};
+
+/**
+ * Pours waiting for, being proved by, or finished on the worker threads.
+ * Only the proving itself runs outside the mutex.
+ */
+class CPourQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    std::map<std::string, CPourOperation> mapOperations;
+    //! Ids of every operation, oldest first
+    std::list<std::string> listOperations;
+    //! Ids of the operations still waiting for a worker
+    std::deque<std::string> queue;
+    unsigned int nFinished;
+
+    json_spirit::Object Status(const std::string& id, const CPourOperation& op) const;
+    void Prune();
+
+public:
+    CPourQueue() : nFinished(0) {}
+
+    /** Queues a pour and returns its id, or "" if -maxpourqueue pours are waiting */
+    std::string Submit(const PourOperationFn& fn);
+    /** Fills in the status of an operation; returns false if the id is unknown */
+    bool GetStatus(const std::string& id, json_spirit::Object& status);
+    /** Statuses of every known operation, oldest first */
+    json_spirit::Array GetStatuses();
+    /** Runs queued pours one after another until the thread is interrupted */
+    void Loop();
+};
+
+/**
+ * Queues a pour for the worker threads and returns its operation id, or
+ * an empty string if -maxpourqueue operations are already waiting.
+ * This and the functions below use the queue of the -pourworkers threads.
+ */
+std::string SubmitPourOperation(const PourOperationFn& fn);
+
+/** Fills in the status of an operation; returns false if the id is unknown */
+bool GetPourOperationStatus(const std::string& id, json_spirit::Object& status);
+
+/** Statuses of every known operation, oldest first */
+json_spirit::Array GetPourOperationStatuses();
+
+/** Body of a -pourworkers thread; returns when the thread is interrupted */
+void ThreadPourWorker();
+
+#endif // BITCOIN_WALLET_ASYNCPOUR_H
@@ -18,6 +18,7 @@
 #include "walletdb.h"
 #include "primitives/transaction.h"
 #include "zcbenchmarks.h"
+#include "wallet/asyncpour.h"
 #include "script/interpreter.h"
 
 #include "sodium.h"
@@ -2387,7 +2388,7 @@ Value zc_benchmark(const json_spirit::Array& params, bool fHelp)
 
     std::vector<double> sample_times;
 
-    if (benchmarktype == "createjoinsplit") {
+    if (benchmarktype == "createjoinsplit" || benchmarktype == "createjoinsplitsinglethreaded") {
         /* Load the proving now key so that it doesn't happen as part of the
          * first joinsplit. */
         pzcashParams->loadProvingKey();
@@ -2400,7 +2401,9 @@ Value zc_benchmark(const json_spirit::Array& params, bool fHelp)
             sample_times.push_back(benchmark_parameter_loading());
         } else if (benchmarktype == "createjoinsplit") {
             sample_times.push_back(benchmark_create_joinsplit());
-        } else if (benchmarktype == "verifyjoinsplit") {
+        } else if (benchmarktype == "createjoinsplitsinglethreaded") {
+            sample_times.push_back(benchmark_create_joinsplit_single_threaded());
+        } else if (benchmarktype == "verifyjoinsplit" || benchmarktype == "verifyjoinsplitoverhead") {
             if (params.size() != 3) {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Please provide a transaction with a JoinSplit.");
             }
@@ -2414,11 +2417,19 @@ Value zc_benchmark(const json_spirit::Array& params, bool fHelp)
                 throw JSONRPCError(RPC_TYPE_ERROR, "The transaction must have exactly one JoinSplit.");
             }
 
-            sample_times.push_back(benchmark_verify_joinsplit(tx.vpour[0]));
+            if (benchmarktype == "verifyjoinsplit") {
+                sample_times.push_back(benchmark_verify_joinsplit(tx.vpour[0]));
+            } else {
+                sample_times.push_back(benchmark_verify_joinsplit_overhead(tx.vpour[0]));
+            }
         } else if (benchmarktype == "solveequihash") {
             sample_times.push_back(benchmark_solve_equihash());
         } else if (benchmarktype == "verifyequihash") {
             sample_times.push_back(benchmark_verify_equihash());
+        } else if (benchmarktype == "verifyequihashmidstate") {
+            sample_times.push_back(benchmark_verify_equihash_midstate());
+        } else if (benchmarktype == "verifyequihashbasic") {
+            sample_times.push_back(benchmark_verify_equihash_basic());
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
@@ -2507,10 +2518,12 @@ Value zc_raw_receive(const json_spirit::Array& params, bool fHelp)
     std::vector<boost::optional<ZCIncrementalWitness>> witnesses;
     uint256 anchor;
     uint256 commitment = decrypted_note.cm();
+    std::vector<uint256> nullifiers = {decrypted_note.nullifier(k)};
     pwalletMain->WitnessBucketCommitment(
         {commitment},
         witnesses,
-        anchor
+        anchor,
+        &nullifiers
     );
 
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -2525,59 +2538,128 @@ Value zc_raw_receive(const json_spirit::Array& params, bool fHelp)
 
 
 
-Value zc_raw_pour(const json_spirit::Array& params, bool fHelp)
+Value zc_raw_scan(const json_spirit::Array& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp)) {
         return Value::null;
     }
 
-    if (fHelp || params.size() != 5) {
+    if (fHelp || params.size() < 1 || params.size() > 2) {
         throw runtime_error(
-            "zcrawpour rawtx inputs outputs vpub_old vpub_new\n"
-            "  inputs: a JSON object mapping {bucket: zcsecretkey, ...}\n"
-            "  outputs: a JSON object mapping {zcaddr: value, ...}\n"
+            "zcrawscan zcsecretkey ( startheight )\n"
             "\n"
-            "Splices a Pour into rawtx. Inputs are unilaterally confidential.\n"
-            "Outputs are confidential between sender/receiver. The vpub_old and\n"
-            "vpub_new values are globally public and move transparent value into\n"
-            "or out of the confidential value store, respectively.\n"
-            "\n"
-            "Note: The caller is responsible for delivering the output enc1 and\n"
-            "enc2 to the appropriate recipients, as well as signing rawtxout and\n"
-            "ensuring it is mined. (A future RPC call will deliver the confidential\n"
-            "payments in-band on the blockchain.)\n"
+            "Rescans the block chain from startheight (default: 0) for buckets\n"
+            "sent to zcsecretkey, adding wallet transactions found on the way as\n"
+            "a rescan on startup would. The commitments of the buckets found are\n"
+            "tracked by the wallet from then on, so that they can be spent with\n"
+            "zcrawpour without rebuilding the commitment tree.\n"
             "\n"
-            "Output: {\n"
-            "  \"encryptedbucket1\": enc1,\n"
-            "  \"encryptedbucket2\": enc2,\n"
-            "  \"rawtxn\": rawtxout\n"
-            "}\n"
+            "Output: [\n"
+            "  {\n"
+            "    \"txid\": txid,\n"
+            "    \"height\": height,\n"
+            "    \"pour\": n,\n"
+            "    \"output\": n,\n"
+            "    \"amount\": value,\n"
+            "    \"bucket\": cleartextbucket\n"
+            "  }, ...\n"
+            "]\n"
             );
     }
 
+    RPCTypeCheck(params, boost::assign::list_of(str_type)(int_type));
+
+    SpendingKey k;
+
+    {
+        CDataStream ssData(ParseHexV(params[0], "zcsecretkey"), SER_NETWORK, PROTOCOL_VERSION);
+        try {
+            ssData >> k;
+        } catch(const std::exception &) {
+            throw runtime_error(
+                "zcsecretkey could not be decoded"
+            );
+        }
+    }
+
     LOCK(cs_main);
 
+    int nHeight = params.size() > 1 ? params[1].get_int() : 0;
+    if (nHeight < 0 || nHeight > chainActive.Height())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+
+    std::vector<CScannedNote> vNotes;
+    pwalletMain->ScanForWalletTransactions(chainActive[nHeight], true, {k}, &vNotes);
+
+    if (!vNotes.empty()) {
+        std::vector<uint256> commitments;
+        std::vector<uint256> nullifiers;
+        BOOST_FOREACH(const CScannedNote& note, vNotes) {
+            commitments.push_back(note.commitment);
+            nullifiers.push_back(note.plaintext.note(k.address()).nullifier(k));
+        }
+        std::vector<boost::optional<ZCIncrementalWitness>> witnesses;
+        uint256 anchor;
+        pwalletMain->WitnessBucketCommitment(commitments, witnesses, anchor, &nullifiers);
+    }
+
+    Array result;
+    BOOST_FOREACH(const CScannedNote& note, vNotes) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << note.plaintext;
+
+        Object entry;
+        entry.push_back(Pair("txid", note.txid.GetHex()));
+        entry.push_back(Pair("height", note.nHeight));
+        entry.push_back(Pair("pour", (int)note.nPour));
+        entry.push_back(Pair("output", (int)note.nOutput));
+        entry.push_back(Pair("amount", ValueFromAmount(note.plaintext.value)));
+        entry.push_back(Pair("bucket", HexStr(ss.begin(), ss.end())));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+/**
+ * The inputs of a pour, gathered from the wallet and the chain under
+ * cs_main so that the proof can be created without any locks held.
+ */
+struct PourRequest
+{
     CTransaction tx;
-    if (!DecodeHexTx(tx, params[0].get_str()))
+    std::vector<JSInput> vpourin;
+    std::vector<JSOutput> vpourout;
+    uint256 anchor;
+    CAmount vpub_old;
+    CAmount vpub_new;
+};
+
+static PourRequest PreparePour(const Array& params)
+{
+    AssertLockHeld(cs_main);
+
+    PourRequest req;
+    if (!DecodeHexTx(req.tx, params[0].get_str()))
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
 
     Object inputs = params[1].get_obj();
     Object outputs = params[2].get_obj();
 
-    CAmount vpub_old(0);
-    CAmount vpub_new(0);
+    req.vpub_old = 0;
+    req.vpub_new = 0;
 
     if (params[3].get_real() != 0.0)
-        vpub_old = AmountFromValue(params[3]);
+        req.vpub_old = AmountFromValue(params[3]);
 
     if (params[4].get_real() != 0.0)
-        vpub_new = AmountFromValue(params[4]);
+        req.vpub_new = AmountFromValue(params[4]);
 
-    std::vector<JSInput> vpourin;
-    std::vector<JSOutput> vpourout;
+    std::vector<JSInput>& vpourin = req.vpourin;
+    std::vector<JSOutput>& vpourout = req.vpourout;
     std::vector<Note> notes;
     std::vector<SpendingKey> keys;
     std::vector<uint256> commitments;
+    std::vector<uint256> nullifiers;
 
     BOOST_FOREACH(const Pair& s, inputs)
     {
@@ -2607,11 +2689,11 @@ Value zc_raw_pour(const json_spirit::Array& params, bool fHelp)
         Note note = npt.note(addr);
         notes.push_back(note);
         commitments.push_back(note.cm());
+        nullifiers.push_back(note.nullifier(k));
     }
 
-    uint256 anchor;
     std::vector<boost::optional<ZCIncrementalWitness>> witnesses;
-    pwalletMain->WitnessBucketCommitment(commitments, witnesses, anchor);
+    pwalletMain->WitnessBucketCommitment(commitments, witnesses, req.anchor, &nullifiers);
 
     assert(witnesses.size() == notes.size());
     assert(notes.size() == keys.size());
@@ -2653,21 +2735,27 @@ Value zc_raw_pour(const json_spirit::Array& params, bool fHelp)
         throw runtime_error("unsupported pour input/output counts");
     }
 
+    return req;
+}
+
+// Creates the proof and signs the transaction; takes tens of seconds.
+static Object CompletePour(const PourRequest& req)
+{
     uint256 joinSplitPubKey;
     unsigned char joinSplitPrivKey[crypto_sign_SECRETKEYBYTES];
     crypto_sign_keypair(joinSplitPubKey.begin(), joinSplitPrivKey);
 
-    CMutableTransaction mtx(tx);
+    CMutableTransaction mtx(req.tx);
     mtx.nVersion = 2;
     mtx.joinSplitPubKey = joinSplitPubKey;
 
     CPourTx pourtx(*pzcashParams,
                    joinSplitPubKey,
-                   anchor,
-                   {vpourin[0], vpourin[1]},
-                   {vpourout[0], vpourout[1]},
-                   vpub_old,
-                   vpub_new);
+                   req.anchor,
+                   {req.vpourin[0], req.vpourin[1]},
+                   {req.vpourout[0], req.vpourout[1]},
+                   req.vpub_old,
+                   req.vpub_new);
 
     assert(pourtx.Verify(*pzcashParams, joinSplitPubKey));
 
@@ -2728,6 +2816,113 @@ Value zc_raw_pour(const json_spirit::Array& params, bool fHelp)
     return result;
 }
 
+Value zc_raw_pour(const json_spirit::Array& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp)) {
+        return Value::null;
+    }
+
+    if (fHelp || params.size() != 5) {
+        throw runtime_error(
+            "zcrawpour rawtx inputs outputs vpub_old vpub_new\n"
+            "  inputs: a JSON object mapping {bucket: zcsecretkey, ...}\n"
+            "  outputs: a JSON object mapping {zcaddr: value, ...}\n"
+            "\n"
+            "Splices a Pour into rawtx. Inputs are unilaterally confidential.\n"
+            "Outputs are confidential between sender/receiver. The vpub_old and\n"
+            "vpub_new values are globally public and move transparent value into\n"
+            "or out of the confidential value store, respectively.\n"
+            "\n"
+            "Note: The caller is responsible for delivering the output enc1 and\n"
+            "enc2 to the appropriate recipients, as well as signing rawtxout and\n"
+            "ensuring it is mined. (A future RPC call will deliver the confidential\n"
+            "payments in-band on the blockchain.)\n"
+            "\n"
+            "Output: {\n"
+            "  \"encryptedbucket1\": enc1,\n"
+            "  \"encryptedbucket2\": enc2,\n"
+            "  \"rawtxn\": rawtxout\n"
+            "}\n"
+            );
+    }
+
+    PourRequest req;
+    {
+        LOCK(cs_main);
+        req = PreparePour(params);
+    }
+
+    return CompletePour(req);
+}
+
+Value zc_raw_pour_async(const json_spirit::Array& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp)) {
+        return Value::null;
+    }
+
+    if (fHelp || params.size() != 5) {
+        throw runtime_error(
+            "zcrawpourasync rawtx inputs outputs vpub_old vpub_new\n"
+            "\n"
+            "Queues a zcrawpour to be proved on a -pourworkers thread and returns\n"
+            "its operation id at once. Poll zcrawpourstatus for the result.\n"
+            "\n"
+            "The arguments are those of zcrawpour, and the result of a successful\n"
+            "operation is the object zcrawpour returns.\n"
+            "\n"
+            "Result:\n"
+            "\"operationid\"    (string) The id to pass to zcrawpourstatus\n"
+            );
+    }
+
+    PourRequest req;
+    {
+        LOCK(cs_main);
+        req = PreparePour(params);
+    }
+
+    std::string id = SubmitPourOperation(std::bind(&CompletePour, req));
+    if (id.empty())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Too many pours are waiting to be proved (see -maxpourqueue)");
+    return id;
+}
+
+Value zc_raw_pour_status(const json_spirit::Array& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp)) {
+        return Value::null;
+    }
+
+    if (fHelp || params.size() > 1) {
+        throw runtime_error(
+            "zcrawpourstatus ( \"operationid\" )\n"
+            "\n"
+            "Returns the status of a pour queued by zcrawpourasync, or of all of\n"
+            "them, oldest first, if no operation id is given.\n"
+            "\n"
+            "Result:\n"
+            "{\n"
+            "  \"id\": \"operationid\",\n"
+            "  \"status\": \"queued\"|\"executing\"|\"success\"|\"failed\",\n"
+            "  \"position\": n,          (numeric) Pours ahead of this one, while queued\n"
+            "  \"waitingtime\": n,       (numeric) Seconds spent waiting for a worker\n"
+            "  \"runningtime\": n,       (numeric) Seconds spent proving, once started\n"
+            "  \"result\": {...},        (object) The zcrawpour result, on success\n"
+            "  \"error\": \"message\"      (string) Why the pour failed, on failure\n"
+            "}\n"
+            );
+    }
+
+    if (params.size() == 0)
+        return GetPourOperationStatuses();
+
+    Object status;
+    if (!GetPourOperationStatus(params[0].get_str(), status))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown operation id");
+    return status;
+}
+
 Value zc_raw_keygen(const json_spirit::Array& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp)) {
@@ -0,0 +1,123 @@
+// Copyright (c) 2016 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/asyncpour.h"
+
+#include "rpcprotocol.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "json/json_spirit_utils.h"
+
+using namespace json_spirit;
+
+BOOST_FIXTURE_TEST_SUITE(asyncpour_tests, BasicTestingSetup)
+
+static std::string StatusOf(CPourQueue& queue, const std::string& id)
+{
+    Object status;
+    BOOST_REQUIRE(queue.GetStatus(id, status));
+    return find_value(status, "status").get_str();
+}
+
+// Waits up to ten seconds for an operation to reach the given status
+static bool WaitForStatus(CPourQueue& queue, const std::string& id, const std::string& strStatus)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (StatusOf(queue, id) == strStatus)
+            return true;
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(pour_queue_full)
+{
+    mapArgs["-maxpourqueue"] = "2";
+    CPourQueue queue;
+    PourOperationFn fn = []() { return Object(); };
+
+    std::string id1 = queue.Submit(fn);
+    std::string id2 = queue.Submit(fn);
+    BOOST_CHECK(!id1.empty() && !id2.empty() && id1 != id2);
+    BOOST_CHECK(queue.Submit(fn).empty());
+
+    // Waiting operations report their place in the queue
+    Object status;
+    BOOST_CHECK(queue.GetStatus(id2, status));
+    BOOST_CHECK_EQUAL(find_value(status, "status").get_str(), "queued");
+    BOOST_CHECK_EQUAL(find_value(status, "position").get_int(), 1);
+    BOOST_CHECK(!queue.GetStatus("opid-unknown", status));
+
+    // Operations that a worker has taken no longer count against the limit
+    boost::thread worker(&CPourQueue::Loop, &queue);
+    BOOST_CHECK(WaitForStatus(queue, id2, "success"));
+    BOOST_CHECK(!queue.Submit(fn).empty());
+
+    worker.interrupt();
+    worker.join();
+    mapArgs.erase("-maxpourqueue");
+}
+
+BOOST_AUTO_TEST_CASE(pour_status_lifecycle)
+{
+    CPourQueue queue;
+    std::atomic<bool> fRelease(false);
+
+    std::string idSuccess = queue.Submit([&fRelease]() {
+        while (!fRelease)
+            MilliSleep(1);
+        Object result;
+        result.push_back(Pair("txid", "00"));
+        return result;
+    });
+    std::string idFailed = queue.Submit([]() -> Object {
+        throw std::runtime_error("proof failed");
+    });
+    std::string idRPCError = queue.Submit([]() -> Object {
+        throw JSONRPCError(RPC_WALLET_ERROR, "no such note");
+    });
+    BOOST_CHECK_EQUAL(StatusOf(queue, idSuccess), "queued");
+
+    boost::thread worker(&CPourQueue::Loop, &queue);
+    BOOST_CHECK(WaitForStatus(queue, idSuccess, "executing"));
+    BOOST_CHECK_EQUAL(StatusOf(queue, idFailed), "queued");
+
+    Object status;
+    BOOST_CHECK(queue.GetStatus(idFailed, status));
+    BOOST_CHECK_EQUAL(find_value(status, "position").get_int(), 0);
+
+    fRelease = true;
+    BOOST_CHECK(WaitForStatus(queue, idSuccess, "success"));
+    BOOST_CHECK(queue.GetStatus(idSuccess, status));
+    BOOST_CHECK_EQUAL(find_value(find_value(status, "result").get_obj(), "txid").get_str(), "00");
+    BOOST_CHECK(find_value(status, "runningtime").get_real() >= 0);
+
+    BOOST_CHECK(WaitForStatus(queue, idFailed, "failed"));
+    BOOST_CHECK(queue.GetStatus(idFailed, status));
+    BOOST_CHECK_EQUAL(find_value(status, "error").get_str(), "proof failed");
+
+    BOOST_CHECK(WaitForStatus(queue, idRPCError, "failed"));
+    BOOST_CHECK(queue.GetStatus(idRPCError, status));
+    BOOST_CHECK_EQUAL(find_value(status, "error").get_str(), "no such note");
+
+    // Every operation is listed, oldest first
+    Array statuses = queue.GetStatuses();
+    BOOST_CHECK_EQUAL(statuses.size(), 3U);
+    BOOST_CHECK_EQUAL(find_value(statuses[0].get_obj(), "id").get_str(), idSuccess);
+    BOOST_CHECK_EQUAL(find_value(statuses[2].get_obj(), "id").get_str(), idRPCError);
+
+    worker.interrupt();
+    worker.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,16 @@
 
 #include "wallet/wallet.h"
 
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "pow.h"
+#include "random.h"
+#include "script/standard.h"
+#include "util.h"
+#include "crypto/equihash.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -307,4 +317,234 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+// A block with one pour per pair of commitments, spending the given serials
+static CBlock block_with_commitments(const vector<uint256>& commitments, const vector<uint256>& serials = vector<uint256>())
+{
+    CMutableTransaction tx;
+    for (size_t i = 0; i < commitments.size(); i += 2) {
+        CPourTx pour;
+        pour.commitments[0] = commitments[i];
+        pour.commitments[1] = commitments[i + 1];
+        if (i < serials.size())
+            pour.serials[0] = serials[i];
+        tx.vpour.push_back(pour);
+    }
+    CBlock block;
+    block.vtx.push_back(CTransaction(tx));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(note_witness_tracking)
+{
+    CWallet trackingWallet;
+    ZCIncrementalMerkleTree tree;
+    vector<ZCIncrementalMerkleTree> trees;
+    vector<CBlockIndex> indexes(4);
+
+    // Commitment 1 of block 1 is ours, witnessed as WitnessBucketCommitment
+    // would have left it
+    uint256 cm;
+    uint256 nf = GetRandHash();
+    for (int nHeight = 1; nHeight <= 3; nHeight++) {
+        vector<uint256> commitments;
+        for (int i = 0; i < 4; i++) {
+            commitments.push_back(GetRandHash());
+        }
+
+        indexes[nHeight - 1].nHeight = nHeight;
+        trees.push_back(tree);
+        if (nHeight == 1) {
+            cm = commitments[1];
+            CNoteWitnesses nw;
+            tree.append(commitments[0]);
+            tree.append(commitments[1]);
+            nw.vWitnesses.push_back(tree.witness());
+            nw.vWitnesses.back().append(commitments[2]);
+            nw.vWitnesses.back().append(commitments[3]);
+            nw.nWitnessHeight = 1;
+            nw.nullifier = nf;
+            trackingWallet.mapNoteWitnesses[cm] = nw;
+            tree.append(commitments[2]);
+            tree.append(commitments[3]);
+            continue;
+        }
+
+        CBlock block = block_with_commitments(commitments);
+        trackingWallet.setNoteWitnessesDirty.clear();
+        trackingWallet.ChainTip(&indexes[nHeight - 1], &block, tree, true);
+        BOOST_FOREACH(const uint256& commitment, commitments)
+            tree.append(commitment);
+
+        const CNoteWitnesses& nw = trackingWallet.mapNoteWitnesses[cm];
+        BOOST_CHECK_EQUAL(nw.nWitnessHeight, nHeight);
+        BOOST_CHECK_EQUAL(nw.vWitnesses.size(), (size_t)nHeight);
+        BOOST_CHECK(nw.vWitnesses.back().root() == tree.root());
+        BOOST_CHECK(trackingWallet.setNoteWitnessesDirty.count(cm));
+    }
+
+    // Rolling back restores the witness as of each earlier block, and
+    // stops tracking the note once it is not in the chain any more
+    for (int nHeight = 3; nHeight >= 1; nHeight--) {
+        CBlock block;
+        trackingWallet.ChainTip(&indexes[nHeight - 1], &block, ZCIncrementalMerkleTree(), false);
+
+        if (nHeight > 1) {
+            const CNoteWitnesses& nw = trackingWallet.mapNoteWitnesses[cm];
+            BOOST_CHECK_EQUAL(nw.nWitnessHeight, nHeight - 1);
+            BOOST_CHECK(nw.vWitnesses.back().root() == trees[nHeight - 1].root());
+        } else {
+            BOOST_CHECK(!trackingWallet.mapNoteWitnesses.count(cm));
+        }
+    }
+
+    // A note is no longer tracked once a block spends it
+    CNoteWitnesses nw;
+    nw.vWitnesses.push_back(tree.witness());
+    nw.nWitnessHeight = 3;
+    nw.nullifier = nf;
+    trackingWallet.mapNoteWitnesses[cm] = nw;
+    trackingWallet.setNoteWitnessesDirty.clear();
+    indexes[3].nHeight = 4;
+    CBlock block = block_with_commitments({GetRandHash(), GetRandHash()}, {nf});
+    trackingWallet.ChainTip(&indexes[3], &block, tree, true);
+    BOOST_CHECK(!trackingWallet.mapNoteWitnesses.count(cm));
+    BOOST_CHECK(trackingWallet.setNoteWitnessesDirty.count(cm));
+
+    // Nor is a note witnessed on another branch at the same height
+    ZCIncrementalMerkleTree otherTree = trees[2];
+    otherTree.append(GetRandHash());
+    nw.vWitnesses.assign(1, otherTree.witness());
+    nw.nullifier = GetRandHash();
+    trackingWallet.mapNoteWitnesses[cm] = nw;
+    trackingWallet.setNoteWitnessesDirty.clear();
+    block = block_with_commitments({GetRandHash(), GetRandHash()});
+    trackingWallet.ChainTip(&indexes[3], &block, tree, true);
+    BOOST_CHECK(!trackingWallet.mapNoteWitnesses.count(cm));
+    BOOST_CHECK(trackingWallet.setNoteWitnessesDirty.count(cm));
+}
+
+// Rescans with one and with several checking threads must add the same
+// transactions as adding each block's transactions in chain order does
+BOOST_AUTO_TEST_CASE(rescan_matches_sequential)
+{
+    // Regtest blocks can be solved quickly enough to be read back from disk
+    SelectParams(CBaseChainParams::REGTEST);
+    const CChainParams& params = Params();
+    unsigned int n = params.EquihashN();
+    unsigned int k = params.EquihashK();
+    arith_uint256 hashTarget = arith_uint256().SetCompact(UintToArith256(params.GetConsensus().powLimit).GetCompact());
+
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = CScript() << OP_TRUE;
+
+    const int nBlocks = 20;
+    vector<CBlock> blocks(nBlocks);
+    vector<uint256> hashes(nBlocks);
+    vector<CBlockIndex> indexes(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock& block = blocks[i];
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << i << OP_0;
+        coinbase.vout.resize(1);
+        coinbase.vout[0].nValue = COIN;
+        coinbase.vout[0].scriptPubKey = i % 3 == 0 ? scriptMine : scriptOther;
+        block.vtx.push_back(CTransaction(coinbase));
+        if (i % 4 == 1) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            tx.vout.resize(2);
+            tx.vout[0].nValue = COIN;
+            tx.vout[0].scriptPubKey = scriptOther;
+            tx.vout[1].nValue = 2 * COIN;
+            tx.vout[1].scriptPubKey = scriptMine;
+            block.vtx.push_back(CTransaction(tx));
+        }
+        block.hashPrevBlock = i ? hashes[i - 1] : uint256();
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        block.nTime = params.GenesisBlock().nTime + i;
+        block.nBits = hashTarget.GetCompact();
+
+        eh_HashState eh_state;
+        InitEquihashHeaderState(&block, params, eh_state);
+        arith_uint256 nonce;
+        bool fSolved = false;
+        while (!fSolved) {
+            block.nNonce = ArithToUint256(nonce);
+            eh_HashState curr_state;
+            curr_state = eh_state;
+            crypto_generichash_blake2b_update(&curr_state, block.nNonce.begin(), block.nNonce.size());
+            std::set<std::vector<unsigned int>> solns;
+            EhOptimisedSolve(n, k, curr_state, solns);
+            BOOST_FOREACH(const std::vector<unsigned int>& soln, solns) {
+                block.nSolution = soln;
+                if (UintToArith256(block.GetHash()) <= hashTarget) {
+                    fSolved = true;
+                    break;
+                }
+            }
+            nonce += 1;
+        }
+
+        CDiskBlockPos pos(1000 + i, 0);
+        BOOST_CHECK(WriteBlockToDisk(block, pos, params.MessageStart()));
+        hashes[i] = block.GetHash();
+        indexes[i] = CBlockIndex(block);
+        indexes[i].phashBlock = &hashes[i];
+        indexes[i].pprev = i ? &indexes[i - 1] : NULL;
+        indexes[i].nHeight = i;
+        indexes[i].nFile = pos.nFile;
+        indexes[i].nDataPos = pos.nPos;
+        indexes[i].nStatus |= BLOCK_HAVE_DATA;
+    }
+
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&indexes[nBlocks - 1]);
+    }
+
+    CWallet walletSequential;
+    int nSequential = 0;
+    {
+        LOCK2(cs_main, walletSequential.cs_wallet);
+        walletSequential.AddKeyPubKey(key, key.GetPubKey());
+        BOOST_FOREACH(const CBlock& block, blocks) {
+            BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+                if (walletSequential.AddToWalletIfInvolvingMe(tx, &block, true))
+                    nSequential++;
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL(nSequential, 7 + 5);
+
+    const char* vThreads[] = {"1", "4"};
+    BOOST_FOREACH(const char* strThreads, vThreads) {
+        mapArgs["-rescanthreads"] = strThreads;
+        CWallet wallet;
+        {
+            LOCK(wallet.cs_wallet);
+            wallet.AddKeyPubKey(key, key.GetPubKey());
+        }
+        BOOST_CHECK_EQUAL(wallet.ScanForWalletTransactions(&indexes[0], true), nSequential);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), walletSequential.mapWallet.size());
+        BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, walletSequential.mapWallet) {
+            BOOST_CHECK(wallet.mapWallet.count(item.first));
+            BOOST_CHECK(wallet.mapWallet[item.first].hashBlock == item.second.hashBlock);
+            BOOST_CHECK_EQUAL(wallet.mapWallet[item.first].nIndex, item.second.nIndex);
+        }
+    }
+    mapArgs.erase("-rescanthreads");
+
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexOldTip);
+    }
+    SelectParams(CBaseChainParams::MAIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,6 +19,7 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <exception>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -279,6 +280,18 @@ void CWallet::SetBestChain(const CBlockLocator& loc)
 {
     CWalletDB walletdb(strWalletFile);
     walletdb.WriteBestBlock(loc);
+
+    // Note witnesses are only saved along with the best block, and are
+    // witnessed from scratch if they're found to be behind it on startup
+    LOCK(cs_wallet);
+    BOOST_FOREACH(const uint256& commitment, setNoteWitnessesDirty) {
+        std::map<uint256, CNoteWitnesses>::const_iterator it = mapNoteWitnesses.find(commitment);
+        if (it != mapNoteWitnesses.end())
+            walletdb.WriteNoteWitnesses(commitment, it->second);
+        else
+            walletdb.EraseNoteWitnesses(commitment);
+    }
+    setNoteWitnessesDirty.clear();
 }
 
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn, bool fExplicit)
@@ -1051,11 +1064,46 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb)
     return pwalletdb->WriteTx(GetHash(), *this);
 }
 
+/**
+ * Finds a witness of each commitment against the current chain, or none
+ * if the commitment isn't in it. The commitments that are found are
+ * tracked from then on, so that the witnesses are simply looked up the
+ * next time, until pNullifiers[i] (if given) is spent.
+ */
 void CWallet::WitnessBucketCommitment(std::vector<uint256> commitments,
                                       std::vector<boost::optional<ZCIncrementalWitness>>& witnesses,
-                                      uint256 &final_anchor)
+                                      uint256 &final_anchor,
+                                      const std::vector<uint256>* pNullifiers)
 {
+    AssertLockHeld(cs_main);
+
     witnesses.resize(commitments.size());
+
+    {
+        LOCK(cs_wallet);
+        bool fTracked = !commitments.empty();
+        BOOST_FOREACH(const uint256& commitment, commitments) {
+            std::map<uint256, CNoteWitnesses>::const_iterator it = mapNoteWitnesses.find(commitment);
+            if (it == mapNoteWitnesses.end() || it->second.nWitnessHeight != chainActive.Height()) {
+                fTracked = false;
+                break;
+            }
+        }
+        if (fTracked) {
+            for (size_t i = 0; i < commitments.size(); i++) {
+                witnesses[i] = mapNoteWitnesses[commitments[i]].vWitnesses.back();
+            }
+            final_anchor = witnesses[0]->root();
+
+            // Witnesses saved before a crash may be for another branch
+            if (final_anchor == pcoinsTip->GetBestAnchor())
+                return;
+            witnesses.assign(commitments.size(), boost::none);
+        }
+    }
+
+    // Witnesses as of the most recent blocks, to be tracked
+    std::vector<CNoteWitnesses> history(commitments.size());
     CBlockIndex* pindex = chainActive.Genesis();
     ZCIncrementalMerkleTree tree;
 
@@ -1092,8 +1140,16 @@ void CWallet::WitnessBucketCommitment(std::vector<uint256> commitments,
 
         // Consistency check: we should be able to find the current tree
         // in our CCoins view.
-        ZCIncrementalMerkleTree dummy_tree;
-        assert(pcoinsTip->GetAnchorAt(current_anchor, dummy_tree));
+        assert(pcoinsTip->HaveAnchor(current_anchor));
+
+        if (pindex->nHeight > chainActive.Height() - (int)WITNESS_CACHE_SIZE) {
+            for (size_t i = 0; i < witnesses.size(); i++) {
+                if (witnesses[i]) {
+                    history[i].vWitnesses.push_back(*witnesses[i]);
+                    history[i].nWitnessHeight = pindex->nHeight;
+                }
+            }
+        }
 
         pindex = chainActive.Next(pindex);
     }
@@ -1106,14 +1162,131 @@ void CWallet::WitnessBucketCommitment(std::vector<uint256> commitments,
             assert(final_anchor == wit->root());
         }
     }
+
+    {
+        LOCK(cs_wallet);
+        for (size_t i = 0; i < commitments.size(); i++) {
+            if (pNullifiers)
+                history[i].nullifier = (*pNullifiers)[i];
+            bool fSpent = pNullifiers && pcoinsTip->GetSerial(history[i].nullifier);
+            if (witnesses[i] && !fSpent)
+                mapNoteWitnesses[commitments[i]] = history[i];
+            else if (!mapNoteWitnesses.erase(commitments[i]))
+                continue;
+            setNoteWitnessesDirty.insert(commitments[i]);
+        }
+    }
+}
+
+void CWallet::LoadNoteWitnesses(const uint256& commitment, const CNoteWitnesses& witnesses)
+{
+    mapNoteWitnesses[commitment] = witnesses;
+}
+
+/**
+ * Keeps the witnesses of tracked notes in step with the chain. When a
+ * block is connected each note's newest witness is copied and the block's
+ * commitments are appended to the copy, and notes the block spends are
+ * no longer tracked. A witness whose root is not that of the tree the
+ * block was appended to belongs to another branch and is dropped. When a
+ * block is disconnected the witness as of that block is dropped again.
+ */
+void CWallet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock,
+                       const ZCIncrementalMerkleTree& tree, bool added)
+{
+    LOCK(cs_wallet);
+
+    if (mapNoteWitnesses.empty())
+        return;
+
+    if (!added) {
+        std::map<uint256, CNoteWitnesses>::iterator it = mapNoteWitnesses.begin();
+        while (it != mapNoteWitnesses.end()) {
+            CNoteWitnesses& nw = it->second;
+            if (nw.nWitnessHeight == pindex->nHeight) {
+                setNoteWitnessesDirty.insert(it->first);
+                nw.vWitnesses.pop_back();
+                nw.nWitnessHeight--;
+                // Once the cache runs out, or the note is not in the chain
+                // any more, it is witnessed from scratch by the next
+                // WitnessBucketCommitment.
+                if (nw.vWitnesses.empty()) {
+                    mapNoteWitnesses.erase(it++);
+                    continue;
+                }
+            }
+            it++;
+        }
+        return;
+    }
+
+    std::set<uint256> setSerials;
+    std::vector<libzcash::SHA256Compress> vCommitments;
+    BOOST_FOREACH(const CTransaction& tx, pblock->vtx) {
+        BOOST_FOREACH(const CPourTx& pour, tx.vpour) {
+            setSerials.insert(pour.serials.begin(), pour.serials.end());
+            vCommitments.insert(vCommitments.end(), pour.commitments.begin(), pour.commitments.end());
+        }
+    }
+
+    std::map<uint256, CNoteWitnesses>::iterator it = mapNoteWitnesses.begin();
+    while (it != mapNoteWitnesses.end()) {
+        CNoteWitnesses& nw = it->second;
+        if (!nw.nullifier.IsNull() && setSerials.count(nw.nullifier)) {
+            setNoteWitnessesDirty.insert(it->first);
+            mapNoteWitnesses.erase(it++);
+            continue;
+        }
+        if (nw.nWitnessHeight == pindex->nHeight - 1) {
+            setNoteWitnessesDirty.insert(it->first);
+            if (nw.vWitnesses.back().root() != tree.root()) {
+                // Witnessed from scratch by the next WitnessBucketCommitment
+                mapNoteWitnesses.erase(it++);
+                continue;
+            }
+            nw.vWitnesses.push_back(nw.vWitnesses.back());
+            nw.vWitnesses.back().append_batch(vCommitments);
+            nw.nWitnessHeight = pindex->nHeight;
+            if (nw.vWitnesses.size() > WITNESS_CACHE_SIZE)
+                nw.vWitnesses.erase(nw.vWitnesses.begin());
+        }
+        it++;
+    }
+}
+
+namespace {
+
+/** A block in flight in ScanForWalletTransactions */
+struct CRescanBlock
+{
+    CBlock block;
+    //! Whether each transaction pays to one of our keys
+    std::vector<bool> vMine;
+    std::vector<CScannedNote> vNotes;
+    //! Set if reading or checking the block threw, to be rethrown by the caller
+    std::exception_ptr error;
+    bool fChecked;
+
+    CRescanBlock() : fChecked(false) {}
+};
+
 }
 
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
- * exist in the wallet will be updated.
+ * exist in the wallet will be updated. Notes that any of vNoteKeys can
+ * decrypt are appended to pvNotes in chain order.
+ *
+ * Blocks are read from disk by one thread up to RESCAN_PREFETCH_BLOCKS
+ * ahead, their outputs are matched against our keys and their notes
+ * trial-decrypted by a pool of -rescanthreads threads, and the results
+ * are added to the wallet in chain order by the calling thread, which
+ * also rethrows anything the other threads threw.
  */
-int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
+int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate,
+                                       const std::vector<libzcash::SpendingKey>& vNoteKeys,
+                                       std::vector<CScannedNote>* pvNotes)
 {
     int ret = 0;
     int64_t nNow = GetTime();
@@ -1125,30 +1298,190 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
-        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
+        while (vNoteKeys.empty() && pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
+        std::vector<CBlockIndex*> vIndex;
+        for (CBlockIndex* pindexScan = pindex; pindexScan; pindexScan = chainActive.Next(pindexScan))
+            vIndex.push_back(pindexScan);
+
+        std::vector<ZCNoteDecryption> vDecryptors;
+        std::vector<libzcash::PaymentAddress> vAddresses;
+        BOOST_FOREACH(libzcash::SpendingKey key, vNoteKeys) {
+            vDecryptors.push_back(ZCNoteDecryption(key.viewing_key()));
+            vAddresses.push_back(key.address());
+        }
+
+        // The threads below take neither cs_main nor cs_wallet, which are
+        // held here until they are done
+        std::vector<CRescanBlock> vBlocks(std::max<size_t>(1, std::min<size_t>(RESCAN_PREFETCH_BLOCKS, vIndex.size())));
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        size_t nNextRead = 0, nNextCheck = 0, nNextCommit = 0;
+        bool fDone = false;
+
+        boost::thread_group threads;
+        threads.create_thread([&]() {
+            RenameThread("bitcoin-rescanrd");
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nNextRead < vIndex.size()) {
+                while (!fDone && nNextRead >= nNextCommit + vBlocks.size())
+                    cond.wait(lock);
+                if (fDone)
+                    return;
+                size_t i = nNextRead;
+                CRescanBlock& rescan = vBlocks[i % vBlocks.size()];
+                lock.unlock();
+                try {
+                    ReadBlockFromDisk(rescan.block, vIndex[i]);
+                } catch (...) {
+                    rescan.error = std::current_exception();
+                }
+                lock.lock();
+                nNextRead++;
+                cond.notify_all();
+            }
+        });
+        int nCheckThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+        if (nCheckThreads <= 0)
+            nCheckThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+        for (int t = 0; t < nCheckThreads; t++) {
+            threads.create_thread([&]() {
+                RenameThread("bitcoin-rescan");
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (true) {
+                    while (!fDone && nNextCheck < vIndex.size() && nNextCheck >= nNextRead)
+                        cond.wait(lock);
+                    if (fDone || nNextCheck == vIndex.size())
+                        return;
+                    size_t i = nNextCheck++;
+                    CRescanBlock& rescan = vBlocks[i % vBlocks.size()];
+                    lock.unlock();
+
+                    try {
+                        // A block that couldn't be read is passed on as is
+                        if (rescan.error)
+                            std::rethrow_exception(rescan.error);
+                        const CBlock& block = rescan.block;
+                        rescan.vMine.resize(block.vtx.size());
+                        std::vector<ZCNoteDecryption::BatchItem> vItems;
+                        std::vector<std::pair<size_t, size_t> > vItemPours;
+                        for (size_t j = 0; j < block.vtx.size(); j++) {
+                            const CTransaction& tx = block.vtx[j];
+                            rescan.vMine[j] = IsMine(tx);
+                            if (vDecryptors.empty())
+                                continue;
+                            for (size_t nPour = 0; nPour < tx.vpour.size(); nPour++) {
+                                const CPourTx& pour = tx.vpour[nPour];
+                                uint256 hSig = ZCJoinSplit::h_sig(pour.randomSeed, pour.serials, tx.joinSplitPubKey);
+                                for (size_t nOutput = 0; nOutput < pour.ciphertexts.size(); nOutput++) {
+                                    ZCNoteDecryption::BatchItem item;
+                                    item.ciphertext = pour.ciphertexts[nOutput];
+                                    item.epk = pour.ephemeralKey;
+                                    item.hSig = hSig;
+                                    item.nonce = nOutput;
+                                    vItems.push_back(item);
+                                    vItemPours.push_back(std::make_pair(j, nPour));
+                                }
+                            }
+                        }
+
+                        BOOST_FOREACH(const ZCNoteDecryption::BatchMatch& match,
+                                      ZCNoteDecryption::decryptBatch(vDecryptors, vItems, 1)) {
+                            const CTransaction& tx = block.vtx[vItemPours[match.item].first];
+                            CScannedNote note;
+                            note.txid = tx.GetHash();
+                            note.nHeight = vIndex[i]->nHeight;
+                            note.nPour = vItemPours[match.item].second;
+                            note.nOutput = vItems[match.item].nonce;
+                            note.nKey = match.key;
+                            try {
+                                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                                ss << match.plaintext;
+                                ss >> note.plaintext;
+                            } catch (const std::exception&) {
+                                continue;
+                            }
+                            // The sender could have encrypted a note other than
+                            // the one committed to
+                            note.commitment = note.plaintext.note(vAddresses[note.nKey]).cm();
+                            if (note.commitment != tx.vpour[note.nPour].commitments[note.nOutput])
+                                continue;
+                            rescan.vNotes.push_back(note);
+                        }
+                    } catch (...) {
+                        rescan.error = std::current_exception();
+                    }
+
+                    lock.lock();
+                    rescan.fChecked = true;
+                    cond.notify_all();
+                }
+            });
+        }
+
+        // The threads use this frame's variables, so they must be stopped
+        // however it is left
+        auto stopThreads = [&]() {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                fDone = true;
+                cond.notify_all();
+            }
+            threads.join_all();
+        };
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
-        {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        try {
+            while (nNextCommit < vIndex.size())
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                pindex = vIndex[nNextCommit];
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                CRescanBlock& rescan = vBlocks[nNextCommit % vBlocks.size()];
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (!rescan.fChecked)
+                        cond.wait(lock);
+                }
+                if (rescan.error)
+                    std::rethrow_exception(rescan.error);
+
+                const CBlock& block = rescan.block;
+                for (size_t j = 0; j < block.vtx.size(); j++)
+                {
+                    const CTransaction& tx = block.vtx[j];
+                    // Only transactions paying to us, or maybe spending from
+                    // or already in the wallet, need a closer look
+                    if (!rescan.vMine[j] && !mapWallet.count(tx.GetHash()) && !IsFromMe(tx))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                        ret++;
+                }
+                if (pvNotes)
+                    pvNotes->insert(pvNotes->end(), rescan.vNotes.begin(), rescan.vNotes.end());
+
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    rescan = CRescanBlock();
+                    nNextCommit++;
+                    cond.notify_all();
+                }
+
+                pindex = chainActive.Next(pindex);
+                if (pindex && GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                }
             }
+        } catch (...) {
+            stopThreads();
+            throw;
         }
+        stopThreads();
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
@@ -50,6 +50,12 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 2;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Blocks of witnesses kept for each tracked note, the deepest reorg they can be rolled back through
+static const unsigned int WITNESS_CACHE_SIZE = 100;
+//! Blocks read from disk ahead of the one being added to the wallet during a rescan
+static const unsigned int RESCAN_PREFETCH_BLOCKS = 64;
+//! -rescanthreads default (threads checking blocks during a rescan, 0 = one per core)
+static const int DEFAULT_RESCAN_THREADS = 0;
 
 class CAccountingEntry;
 class CBlockIndex;
@@ -93,6 +99,50 @@ public:
     }
 };
 
+/**
+ * Witnesses of a note commitment that the wallet brings up to date as
+ * blocks are connected, so that spending the note doesn't need the
+ * commitment tree to be rebuilt from the genesis block.
+ */
+class CNoteWitnesses
+{
+public:
+    //! Witness as of each of the most recent blocks, newest last
+    std::vector<ZCIncrementalWitness> vWitnesses;
+    //! Height of the block the newest witness is for, -1 if there is none
+    int nWitnessHeight;
+    //! Serial that spends the note, null if unknown; the note is dropped once it is spent
+    uint256 nullifier;
+
+    CNoteWitnesses() : nWitnessHeight(-1) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        if (!(nType & SER_GETHASH))
+            READWRITE(nVersion);
+        READWRITE(vWitnesses);
+        READWRITE(nWitnessHeight);
+        READWRITE(nullifier);
+    }
+};
+
+/** A note found by ScanForWalletTransactions for one of the keys it was given */
+struct CScannedNote
+{
+    uint256 txid;
+    int nHeight;
+    //! Index of the pour in the transaction
+    size_t nPour;
+    //! Index of the note among the pour's outputs
+    size_t nOutput;
+    //! Index of the key that decrypted it
+    size_t nKey;
+    libzcash::NotePlaintext plaintext;
+    uint256 commitment;
+};
+
 /** Address book data */
 class CAddressBookData
 {
@@ -526,6 +576,11 @@ public:
 
     std::map<uint256, CWalletTx> mapWallet;
 
+    //! Note commitments whose witnesses are kept up to date, see WitnessBucketCommitment
+    std::map<uint256, CNoteWitnesses> mapNoteWitnesses;
+    //! Commitments whose entry in mapNoteWitnesses changed or went since SetBestChain
+    std::set<uint256> setNoteWitnessesDirty;
+
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -619,8 +674,13 @@ public:
     void WitnessBucketCommitment(
          std::vector<uint256> commitments,
          std::vector<boost::optional<ZCIncrementalWitness>>& witnesses,
-         uint256 &final_anchor);
-    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+         uint256 &final_anchor,
+         const std::vector<uint256>* pNullifiers = NULL);
+    void LoadNoteWitnesses(const uint256& commitment, const CNoteWitnesses& witnesses);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, const ZCIncrementalMerkleTree& tree, bool added);
+    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false,
+                                  const std::vector<libzcash::SpendingKey>& vNoteKeys = std::vector<libzcash::SpendingKey>(),
+                                  std::vector<CScannedNote>* pvNotes = NULL);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime);
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime);
@@ -139,6 +139,18 @@ bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
     return Read(std::string("bestblock"), locator);
 }
 
+bool CWalletDB::WriteNoteWitnesses(const uint256& commitment, const CNoteWitnesses& witnesses)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("notewitnesses"), commitment), witnesses);
+}
+
+bool CWalletDB::EraseNoteWitnesses(const uint256& commitment)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("notewitnesses"), commitment));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext)
 {
     nWalletDBUpdated++;
@@ -579,6 +591,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         {
             ssValue >> pwallet->nOrderPosNext;
         }
+        else if (strType == "notewitnesses")
+        {
+            uint256 commitment;
+            ssKey >> commitment;
+            CNoteWitnesses witnesses;
+            ssValue >> witnesses;
+            pwallet->LoadNoteWitnesses(commitment, witnesses);
+        }
         else if (strType == "destdata")
         {
             std::string strAddress, strKey, strValue;
@@ -22,6 +22,7 @@ class CAccountingEntry;
 struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
+class CNoteWitnesses;
 class CScript;
 class CWallet;
 class CWalletTx;
@@ -101,6 +102,9 @@ public:
     bool WriteBestBlock(const CBlockLocator& locator);
     bool ReadBestBlock(CBlockLocator& locator);
 
+    bool WriteNoteWitnesses(const uint256& commitment, const CNoteWitnesses& witnesses);
+    bool EraseNoteWitnesses(const uint256& commitment);
+
     bool WriteOrderPosNext(int64_t nOrderPosNext);
 
     bool WriteDefaultKey(const CPubKey& vchPubKey);
@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <stdexcept>
 
 #include <boost/foreach.hpp>
 
 #include "zcash/IncrementalMerkleTree.hpp"
 #include "crypto/sha256.h"
+#include "memusage.h"
 #include "zerocash/utils/util.h" // TODO: remove these utilities
 
 namespace libzcash {
@@ -107,6 +109,124 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalMerkleTree<Depth, Hash>::append_batch(typename std::vector<Hash>::const_iterator begin,
+                                                      typename std::vector<Hash>::const_iterator end) {
+    if (begin == end) {
+        return;
+    }
+
+    // The nodes of the current level still to be combined, starting at an
+    // even (left) position. The leaves stay uncombined until the next
+    // append, as in append(), so the last pair of them is kept back.
+    std::vector<Hash> nodes;
+    if (left) {
+        nodes.push_back(*left);
+    }
+    if (right) {
+        nodes.push_back(*right);
+    }
+    nodes.insert(nodes.end(), begin, end);
+
+    size_t keep = nodes.size() % 2 ? 1 : 2;
+    boost::optional<Hash> new_left = nodes[nodes.size() - keep];
+    boost::optional<Hash> new_right;
+    if (keep == 2) {
+        new_right = nodes.back();
+    }
+    nodes.resize(nodes.size() - keep);
+
+    std::vector<boost::optional<Hash>> new_parents(parents);
+    std::vector<Hash> combined;
+    for (size_t d = 1; !nodes.empty(); d++) {
+        if (d >= Depth) {
+            throw std::runtime_error("tree is full");
+        }
+
+        // Hash the whole level in one pass
+        combined.resize(nodes.size() / 2);
+        for (size_t i = 0; i < combined.size(); i++) {
+            combined[i] = Hash::combine(nodes[2 * i], nodes[2 * i + 1]);
+        }
+
+        if (d > new_parents.size()) {
+            new_parents.push_back(boost::none);
+        }
+        nodes.clear();
+        if (new_parents[d - 1]) {
+            nodes.push_back(*new_parents[d - 1]);
+        }
+        nodes.insert(nodes.end(), combined.begin(), combined.end());
+
+        // An unpaired node is left waiting for its sibling
+        if (nodes.size() % 2) {
+            new_parents[d - 1] = nodes.back();
+            nodes.pop_back();
+        } else {
+            new_parents[d - 1] = boost::none;
+        }
+    }
+
+    left = new_left;
+    right = new_right;
+    parents.swap(new_parents);
+}
+
+template<size_t Depth, typename Hash>
+IncrementalMerkleTree<Depth, Hash>::IncrementalMerkleTree(const IncrementalMerkleTree& base,
+                                                          const IncrementalMerkleTreeDelta<Depth, Hash>& delta)
+    : left(delta.left), right(delta.right), parents(base.parents) {
+    parents.resize(delta.num_parents);
+
+    BOOST_FOREACH(const auto& changed, delta.changed_parents) {
+        if (changed.first >= parents.size()) {
+            throw std::ios_base::failure("tree delta changes a parent the tree does not have");
+        }
+        parents[changed.first] = changed.second;
+    }
+
+    wfcheck();
+}
+
+template<size_t Depth, typename Hash>
+IncrementalMerkleTreeDelta<Depth, Hash> IncrementalMerkleTree<Depth, Hash>::delta(const IncrementalMerkleTree& base) const {
+    IncrementalMerkleTreeDelta<Depth, Hash> ret;
+    ret.left = left;
+    ret.right = right;
+    ret.num_parents = parents.size();
+
+    for (size_t i = 0; i < parents.size(); i++) {
+        if (i >= base.parents.size() || parents[i] != base.parents[i]) {
+            ret.changed_parents.push_back(std::make_pair((unsigned char) i, parents[i]));
+        }
+    }
+
+    return ret;
+}
+
+// This is the number of objects that have been appended to the tree.
+template<size_t Depth, typename Hash>
+size_t IncrementalMerkleTree<Depth, Hash>::size() const {
+    size_t ret = 0;
+    if (left) {
+        ret++;
+    }
+    if (right) {
+        ret++;
+    }
+    for (size_t i = 0; i < parents.size(); i++) {
+        if (parents[i]) {
+            ret += (size_t(1) << (i + 1));
+        }
+    }
+    return ret;
+}
+
+template<size_t Depth, typename Hash>
+size_t IncrementalMerkleTree<Depth, Hash>::DynamicMemoryUsage() const {
+    return memusage::DynamicUsage(parents);
+}
+
 // This is for allowing the witness to determine if a subtree has filled
 // to a particular depth, or for append() to ensure we're not appending
 // to a full tree.
@@ -293,6 +413,41 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append_batch(const std::vector<Hash>& objs) {
+    typename std::vector<Hash>::const_iterator it = objs.begin();
+
+    while (it != objs.end()) {
+        if (!cursor) {
+            cursor_depth = tree.next_depth(filled.size());
+
+            if (cursor_depth >= Depth) {
+                throw std::runtime_error("tree is full");
+            }
+
+            if (cursor_depth == 0) {
+                filled.push_back(*it);
+                it++;
+                continue;
+            }
+
+            cursor = IncrementalMerkleTree<Depth, Hash>();
+        }
+
+        // Fill the cursor with as many objects as it has room for
+        size_t room = (size_t(1) << cursor_depth) - cursor->size();
+        typename std::vector<Hash>::const_iterator next =
+            it + std::min<size_t>(room, objs.end() - it);
+        cursor->append_batch(it, next);
+        it = next;
+
+        if (cursor->is_complete(cursor_depth)) {
+            filled.push_back(cursor->root(cursor_depth));
+            cursor = boost::none;
+        }
+    }
+}
+
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
 
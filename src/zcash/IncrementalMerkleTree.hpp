@@ -2,6 +2,7 @@
 #define ZCINCREMENTALMERKLETREE_H_
 
 #include <deque>
+#include <vector>
 #include <boost/optional.hpp>
 #include <boost/static_assert.hpp>
 
@@ -50,6 +51,29 @@ private:
 template<size_t Depth, typename Hash>
 class IncrementalWitness;
 
+// The difference between a tree and an earlier state of it: the leaves,
+// and those parents that have changed.
+template<size_t Depth, typename Hash>
+class IncrementalMerkleTreeDelta {
+public:
+    boost::optional<Hash> left;
+    boost::optional<Hash> right;
+    unsigned char num_parents;
+    std::vector<std::pair<unsigned char, boost::optional<Hash>>> changed_parents;
+
+    IncrementalMerkleTreeDelta() : num_parents(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(left);
+        READWRITE(right);
+        READWRITE(num_parents);
+        READWRITE(changed_parents);
+    }
+};
+
 template<size_t Depth, typename Hash>
 class IncrementalMerkleTree {
 
@@ -60,7 +84,27 @@ public:
 
     IncrementalMerkleTree() { }
 
+    // Rebuilds a tree from base and base's delta to it. Throws
+    // std::ios_base::failure if the result is not a well-formed tree.
+    IncrementalMerkleTree(const IncrementalMerkleTree& base,
+                          const IncrementalMerkleTreeDelta<Depth, Hash>& delta);
+
+    // The delta from base to this tree. It is small when base is an
+    // earlier state of this tree, and correct whatever base is.
+    IncrementalMerkleTreeDelta<Depth, Hash> delta(const IncrementalMerkleTree& base) const;
+
+    // The number of objects that have been appended to the tree
+    size_t size() const;
+
+    // The memory allocated by the tree, not counting the tree itself
+    size_t DynamicMemoryUsage() const;
+
     void append(Hash obj);
+    // Appends the objects in order, hashing each level of the tree once
+    // for all of them rather than once per object
+    void append_batch(const std::vector<Hash>& objs) {
+        append_batch(objs.begin(), objs.end());
+    }
     Hash root() const {
         return root(Depth, std::deque<Hash>());
     }
@@ -95,6 +139,8 @@ private:
     Hash root(size_t depth, std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
     bool is_complete(size_t depth = Depth) const;
     size_t next_depth(size_t skip) const;
+    void append_batch(typename std::vector<Hash>::const_iterator begin,
+                      typename std::vector<Hash>::const_iterator end);
     void wfcheck() const;
 };
 
@@ -103,6 +149,9 @@ class IncrementalWitness {
 friend class IncrementalMerkleTree<Depth, Hash>;
 
 public:
+    // Required for deserialization
+    IncrementalWitness() {}
+
     MerklePath path() const {
         return tree.path(partial_path());
     }
@@ -112,6 +161,7 @@ public:
     }
 
     void append(Hash obj);
+    void append_batch(const std::vector<Hash>& objs);
 
     ADD_SERIALIZE_METHODS;
 
@@ -146,6 +196,8 @@ public:
 typedef libzcash::IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::SHA256Compress> ZCIncrementalMerkleTree;
 typedef libzcash::IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, libzcash::SHA256Compress> ZCTestingIncrementalMerkleTree;
 
+typedef libzcash::IncrementalMerkleTreeDelta<INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::SHA256Compress> ZCIncrementalMerkleTreeDelta;
+
 typedef libzcash::IncrementalWitness<INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::SHA256Compress> ZCIncrementalWitness;
 typedef libzcash::IncrementalWitness<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, libzcash::SHA256Compress> ZCTestingIncrementalWitness;
 
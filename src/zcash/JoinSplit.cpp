@@ -5,8 +5,20 @@
 #include "zerocash/utils/util.h"
 #include "zcash/util.h"
 
+#include <atomic>
 #include <memory>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/optional.hpp>
@@ -26,39 +38,101 @@ namespace libzcash {
 
 CCriticalSection cs_ParamsIO;
 CCriticalSection cs_InitializeParams;
+CCriticalSection cs_LoadProvingKey;
 
 template<typename T>
 void saveToFile(std::string path, T& obj) {
     LOCK(cs_ParamsIO);
 
-    std::stringstream ss;
-    ss << obj;
     std::ofstream fh;
     fh.open(path, std::ios::binary);
-    ss.rdbuf()->pubseekpos(0, std::ios_base::out);
-    fh << ss.rdbuf();
+    fh << obj;
     fh.flush();
     fh.close();
 }
 
-template<typename T>
-void loadFromFile(std::string path, boost::optional<T>& objIn) {
-    LOCK(cs_ParamsIO);
+// Read-only stream buffer over bytes held elsewhere, so that libsnark
+// objects can be decoded from them without copying them into a stream.
+class ReadOnlyBuf : public std::streambuf {
+public:
+    ReadOnlyBuf() {}
+    ReadOnlyBuf(const unsigned char* p, size_t len) { set(p, len); }
+
+protected:
+    void set(const unsigned char* p, size_t len) {
+        char* begin = const_cast<char*>(reinterpret_cast<const char*>(p));
+        setg(begin, begin, begin + len);
+    }
+};
 
-    std::stringstream ss;
-    std::ifstream fh(path, std::ios::binary);
+// Read-only stream buffer over a memory-mapped file, so that keys are
+// decoded straight from the page cache instead of from a heap copy of
+// the whole file.
+class MappedFileBuf : public ReadOnlyBuf {
+public:
+    MappedFileBuf() : data(NULL), size(0) {}
+    ~MappedFileBuf() { close(); }
+
+    bool open(const std::string& path) {
+#ifndef WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        // The keys are read front to back
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        data = static_cast<char*>(p);
+        size = st.st_size;
+        set(reinterpret_cast<unsigned char*>(data), size);
+        return true;
+#else
+        return false;
+#endif
+    }
 
-    if(!fh.is_open()) {
-        throw std::runtime_error((boost::format("could not load param file at %s") % path).str());
+    void close() {
+#ifndef WIN32
+        if (data) {
+            munmap(data, size);
+        }
+#endif
+        data = NULL;
+        size = 0;
     }
 
-    ss << fh.rdbuf();
-    fh.close();
+private:
+    char* data;
+    size_t size;
+};
 
-    ss.rdbuf()->pubseekpos(0, std::ios_base::in);
+template<typename T>
+void loadFromFile(std::string path, boost::optional<T>& objIn) {
+    LOCK(cs_ParamsIO);
 
     T obj;
-    ss >> obj;
+    MappedFileBuf buf;
+    if (buf.open(path)) {
+        std::istream is(&buf);
+        is >> obj;
+    } else {
+        std::ifstream fh(path, std::ios::binary);
+
+        if(!fh.is_open()) {
+            throw std::runtime_error((boost::format("could not load param file at %s") % path).str());
+        }
+
+        fh >> obj;
+    }
 
     objIn = std::move(obj);
 }
@@ -71,7 +145,11 @@ public:
 
     boost::optional<r1cs_ppzksnark_proving_key<ppzksnark_ppT>> pk;
     boost::optional<r1cs_ppzksnark_verification_key<ppzksnark_ppT>> vk;
+    // Built from vk whenever it is set, so that proofs are checked with
+    // the online verifier instead of reprocessing the key each time
+    boost::optional<r1cs_ppzksnark_processed_verification_key<ppzksnark_ppT>> pvk;
     boost::optional<std::string> pkPath;
+    std::atomic<unsigned int> nProverThreads;
 
     static void initialize() {
         LOCK(cs_InitializeParams);
@@ -84,6 +162,8 @@ public:
     }
 
     void loadProvingKey() {
+        // Several threads may be proving at once
+        LOCK(cs_LoadProvingKey);
         if (!pk) {
             if (!pkPath) {
                 throw std::runtime_error("proving key path unknown");
@@ -101,6 +181,7 @@ public:
     }
     void loadVerifyingKey(std::string path) {
         loadFromFile(path, vk);
+        pvk = r1cs_ppzksnark_verifier_process_vk<ppzksnark_ppT>(*vk);
     }
     void saveVerifyingKey(std::string path) {
         if (vk) {
@@ -110,6 +191,13 @@ public:
         }
     }
 
+    void setProverThreads(unsigned int nThreads) {
+        nProverThreads = nThreads;
+    }
+    unsigned int getProverThreads() const {
+        return nProverThreads;
+    }
+
     void generate() {
         protoboard<FieldT> pb;
 
@@ -121,9 +209,10 @@ public:
 
         pk = keypair.pk;
         vk = keypair.vk;
+        pvk = r1cs_ppzksnark_verifier_process_vk<ppzksnark_ppT>(*vk);
     }
 
-    JoinSplitCircuit() {}
+    JoinSplitCircuit() : nProverThreads(0) {}
 
     bool verify(
         const boost::array<unsigned char, ZKSNARK_PROOF_SIZE>& proof,
@@ -141,14 +230,11 @@ public:
         }
 
         r1cs_ppzksnark_proof<ppzksnark_ppT> r1cs_proof;
-        std::stringstream ss;
-        std::string proof_str(proof.begin(), proof.end());
-        ss.str(proof_str);
-        ss >> r1cs_proof;
+        decode_proof(proof, r1cs_proof);
 
         uint256 h_sig = this->h_sig(randomSeed, nullifiers, pubKeyHash);
 
-        auto witness = joinsplit_gadget<FieldT, NumInputs, NumOutputs>::witness_map(
+        auto witness = joinsplit_gadget<FieldT, NumInputs, NumOutputs>::packed_witness_map(
             rt,
             h_sig,
             macs,
@@ -158,7 +244,150 @@ public:
             vpub_new
         );
 
-        return r1cs_ppzksnark_verifier_strong_IC<ppzksnark_ppT>(*vk, witness, r1cs_proof);
+        return r1cs_ppzksnark_online_verifier_strong_IC<ppzksnark_ppT>(*pvk, witness, r1cs_proof);
+    }
+
+    static void decode_proof(
+        const boost::array<unsigned char, ZKSNARK_PROOF_SIZE>& proof,
+        r1cs_ppzksnark_proof<ppzksnark_ppT>& r1cs_proof
+    ) {
+        ReadOnlyBuf buf(proof.begin(), proof.size());
+        std::istream is(&buf);
+        is >> r1cs_proof;
+    }
+
+    static r1cs_primary_input<FieldT> statement_inputs(const typename JoinSplit<NumInputs, NumOutputs>::Statement& st) {
+        uint256 h_sig = JoinSplit<NumInputs, NumOutputs>::h_sig(st.randomSeed, st.nullifiers, st.pubKeyHash);
+
+        return joinsplit_gadget<FieldT, NumInputs, NumOutputs>::packed_witness_map(
+            st.rt,
+            h_sig,
+            st.macs,
+            st.nullifiers,
+            st.commitments,
+            st.vpub_old,
+            st.vpub_new
+        );
+    }
+
+    static bool decode_statement(const typename JoinSplit<NumInputs, NumOutputs>::Statement& statement) {
+        r1cs_ppzksnark_proof<ppzksnark_ppT> r1cs_proof;
+        decode_proof(statement.proof, r1cs_proof);
+        auto witness = statement_inputs(statement);
+        return r1cs_proof.is_well_formed() && witness.size() == joinsplit_gadget<FieldT, NumInputs, NumOutputs>::verifying_field_element_size();
+    }
+
+    bool verifyBatch(const std::vector<typename JoinSplit<NumInputs, NumOutputs>::Statement>& statements) {
+        if (!vk) {
+            throw std::runtime_error("JoinSplit verifying key not loaded");
+        }
+
+        if (statements.empty()) {
+            return true;
+        }
+
+        typedef G1<ppzksnark_ppT> G1T;
+        typedef G2<ppzksnark_ppT> G2T;
+        typedef Fqk<ppzksnark_ppT> FqkT;
+
+        // Each proof's pairing equations are scaled by a random 128-bit r
+        // and summed, so an invalid proof only goes unnoticed with
+        // negligible probability. Except for the QAP check, one side of
+        // every equation is fixed by the key, which lets the proofs share
+        // the same two Miller loops.
+        G1T sum_A_g = G1T::zero(), sum_A_h = G1T::zero();
+        G1T sum_B_h = G1T::zero();
+        G2T sum_B_g = G2T::zero();
+        G1T sum_C_g = G1T::zero(), sum_C_h = G1T::zero();
+        G1T sum_H = G1T::zero(), sum_K = G1T::zero();
+        G1T sum_A_acc_C = G1T::zero();
+        FqkT QAP_1 = FqkT::one();
+
+        for (const auto& st : statements) {
+            r1cs_ppzksnark_proof<ppzksnark_ppT> r1cs_proof;
+            decode_proof(st.proof, r1cs_proof);
+
+            if (!r1cs_proof.is_well_formed()) {
+                return false;
+            }
+
+            auto witness = statement_inputs(st);
+
+            if (pvk->encoded_IC_query.domain_size() != witness.size()) {
+                return false;
+            }
+            const G1T acc = pvk->encoded_IC_query.template accumulate_chunk<FieldT>(witness.begin(), witness.end(), 0).first;
+
+            bigint<FieldT::num_limbs> r_bits;
+            r_bits.clear();
+            uint256 r_rand = random_uint256();
+            memcpy(r_bits.data, r_rand.begin(), 16);
+            const FieldT r(r_bits);
+
+            const G1T A_acc = r * (r1cs_proof.g_A.g + acc);
+            const G1T C_g = r * r1cs_proof.g_C.g;
+            const G2T B_g = r * r1cs_proof.g_B.g;
+
+            sum_A_g = sum_A_g + r * r1cs_proof.g_A.g;
+            sum_A_h = sum_A_h + r * r1cs_proof.g_A.h;
+            sum_B_g = sum_B_g + B_g;
+            sum_B_h = sum_B_h + r * r1cs_proof.g_B.h;
+            sum_C_g = sum_C_g + C_g;
+            sum_C_h = sum_C_h + r * r1cs_proof.g_C.h;
+            sum_H = sum_H + r * r1cs_proof.g_H;
+            sum_K = sum_K + r * r1cs_proof.g_K;
+            sum_A_acc_C = sum_A_acc_C + A_acc + C_g;
+
+            // e(A + acc, B) has a term from the proof on both sides, so it
+            // needs a Miller loop per proof; r is applied to A only.
+            QAP_1 = QAP_1 * ppzksnark_ppT::miller_loop(
+                ppzksnark_ppT::precompute_G1(A_acc),
+                ppzksnark_ppT::precompute_G2(r1cs_proof.g_B.g));
+        }
+
+        const auto& G2_one = pvk->pp_G2_one_precomp;
+
+        // Knowledge commitment checks
+        FqkT kc_A = ppzksnark_ppT::double_miller_loop(
+            ppzksnark_ppT::precompute_G1(sum_A_g), pvk->vk_alphaA_g2_precomp,
+            ppzksnark_ppT::precompute_G1(-sum_A_h), G2_one);
+        if (ppzksnark_ppT::final_exponentiation(kc_A) != GT<ppzksnark_ppT>::one()) {
+            return false;
+        }
+
+        FqkT kc_B = ppzksnark_ppT::double_miller_loop(
+            pvk->vk_alphaB_g1_precomp, ppzksnark_ppT::precompute_G2(sum_B_g),
+            ppzksnark_ppT::precompute_G1(-sum_B_h), G2_one);
+        if (ppzksnark_ppT::final_exponentiation(kc_B) != GT<ppzksnark_ppT>::one()) {
+            return false;
+        }
+
+        FqkT kc_C = ppzksnark_ppT::double_miller_loop(
+            ppzksnark_ppT::precompute_G1(sum_C_g), pvk->vk_alphaC_g2_precomp,
+            ppzksnark_ppT::precompute_G1(-sum_C_h), G2_one);
+        if (ppzksnark_ppT::final_exponentiation(kc_C) != GT<ppzksnark_ppT>::one()) {
+            return false;
+        }
+
+        // QAP divisibility check
+        FqkT QAP_23 = ppzksnark_ppT::double_miller_loop(
+            ppzksnark_ppT::precompute_G1(sum_H), pvk->vk_rC_Z_g2_precomp,
+            ppzksnark_ppT::precompute_G1(sum_C_g), G2_one);
+        if (ppzksnark_ppT::final_exponentiation(QAP_1 * QAP_23.unitary_inverse()) != GT<ppzksnark_ppT>::one()) {
+            return false;
+        }
+
+        // Same coefficients check
+        FqkT K_1 = ppzksnark_ppT::miller_loop(
+            ppzksnark_ppT::precompute_G1(sum_K), pvk->vk_gamma_g2_precomp);
+        FqkT K_23 = ppzksnark_ppT::double_miller_loop(
+            ppzksnark_ppT::precompute_G1(sum_A_acc_C), pvk->vk_gamma_beta_g2_precomp,
+            pvk->vk_gamma_beta_g1_precomp, ppzksnark_ppT::precompute_G2(sum_B_g));
+        if (ppzksnark_ppT::final_exponentiation(K_1 * K_23.unitary_inverse()) != GT<ppzksnark_ppT>::one()) {
+            return false;
+        }
+
+        return true;
     }
 
     boost::array<unsigned char, ZKSNARK_PROOF_SIZE> prove(
@@ -236,10 +465,12 @@ public:
         std::vector<FieldT> aux_input;
 
         {
+            // The proving key carries the circuit's constraint system, so
+            // only the witness is built here and it is checked against the
+            // key's copy rather than regenerating the constraints.
             protoboard<FieldT> pb;
             {
                 joinsplit_gadget<FieldT, NumInputs, NumOutputs> g(pb);
-                g.generate_r1cs_constraints();
                 g.generate_r1cs_witness(
                     phi,
                     rt,
@@ -251,14 +482,24 @@ public:
                 );
             }
 
-            if (!pb.is_satisfied()) {
-                throw std::invalid_argument("Constraint system not satisfied by inputs");
+            if (pb.num_variables() != pk->constraint_system.num_variables()) {
+                throw std::runtime_error("JoinSplit proving key does not match the circuit");
             }
 
             primary_input = pb.primary_input();
             aux_input = pb.auxiliary_input();
         }
 
+        if (!pk->constraint_system.is_satisfied(primary_input, aux_input)) {
+            throw std::invalid_argument("Constraint system not satisfied by inputs");
+        }
+
+#ifdef MULTICORE
+        // The thread count only applies to the calling thread's parallel
+        // regions, so it is set on every call.
+        omp_set_num_threads(nProverThreads ? nProverThreads : omp_get_num_procs());
+#endif
+
         auto proof = r1cs_ppzksnark_prover<ppzksnark_ppT>(
             *pk,
             primary_input,
@@ -295,6 +536,12 @@ JoinSplit<NumInputs, NumOutputs>* JoinSplit<NumInputs, NumOutputs>::Unopened()
     return new JoinSplitCircuit<NumInputs, NumOutputs>();
 }
 
+template<size_t NumInputs, size_t NumOutputs>
+bool DecodeJoinSplitStatement(const typename JoinSplit<NumInputs, NumOutputs>::Statement& statement)
+{
+    return JoinSplitCircuit<NumInputs, NumOutputs>::decode_statement(statement);
+}
+
 template<size_t NumInputs, size_t NumOutputs>
 uint256 JoinSplit<NumInputs, NumOutputs>::h_sig(
     const uint256& randomSeed,
@@ -349,4 +596,7 @@ JSInput::JSInput() : witness(ZCIncrementalMerkleTree().witness()),
 template class JoinSplit<ZC_NUM_JS_INPUTS,
                          ZC_NUM_JS_OUTPUTS>;
 
+template bool DecodeJoinSplitStatement<ZC_NUM_JS_INPUTS,
+                                       ZC_NUM_JS_OUTPUTS>(const ZCJoinSplit::Statement& statement);
+
 }
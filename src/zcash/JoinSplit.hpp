@@ -12,6 +12,8 @@
 
 #include <boost/array.hpp>
 
+#include <vector>
+
 namespace libzcash {
 
 class JSInput {
@@ -44,6 +46,19 @@ public:
 template<size_t NumInputs, size_t NumOutputs>
 class JoinSplit {
 public:
+    // The proof and public inputs of one JoinSplit, as passed to verify()
+    struct Statement {
+        boost::array<unsigned char, ZKSNARK_PROOF_SIZE> proof;
+        uint256 pubKeyHash;
+        uint256 randomSeed;
+        boost::array<uint256, NumInputs> macs;
+        boost::array<uint256, NumInputs> nullifiers;
+        boost::array<uint256, NumOutputs> commitments;
+        uint64_t vpub_old;
+        uint64_t vpub_new;
+        uint256 rt;
+    };
+
     static JoinSplit<NumInputs, NumOutputs>* Generate();
     static JoinSplit<NumInputs, NumOutputs>* Unopened();
     static uint256 h_sig(const uint256& randomSeed,
@@ -59,6 +74,11 @@ public:
     virtual void loadVerifyingKey(std::string path) = 0;
     virtual void saveVerifyingKey(std::string path) = 0;
 
+    // Sets the number of threads prove() uses for its multi-exponentiations
+    // and FFTs (0 = one per core).
+    virtual void setProverThreads(unsigned int nThreads) = 0;
+    virtual unsigned int getProverThreads() const = 0;
+
     virtual boost::array<unsigned char, ZKSNARK_PROOF_SIZE> prove(
         const boost::array<JSInput, NumInputs>& inputs,
         const boost::array<JSOutput, NumOutputs>& outputs,
@@ -87,10 +107,23 @@ public:
         const uint256& rt
     ) = 0;
 
+    // Checks all of the proofs at once by random linear combination, so
+    // that most of the pairing work is shared between them. Returns true
+    // only if every proof is valid; when it returns false, verify() must
+    // be used to find the invalid ones.
+    virtual bool verifyBatch(const std::vector<Statement>& statements) = 0;
+
 protected:
     JoinSplit() {}
 };
 
+// Decodes the proof and builds the public inputs of a statement, the part
+// of verify() that does no pairings. Returns false if the proof is
+// malformed. Used to benchmark the verifier's overhead; a JoinSplit must
+// already have been created so that the curve parameters are set up.
+template<size_t NumInputs, size_t NumOutputs>
+bool DecodeJoinSplitStatement(const typename JoinSplit<NumInputs, NumOutputs>::Statement& statement);
+
 }
 
 typedef libzcash::JoinSplit<ZC_NUM_JS_INPUTS,
@@ -1,5 +1,7 @@
 #include "NoteEncryption.hpp"
+#include <algorithm>
 #include <stdexcept>
+#include <thread>
 #include "sodium.h"
 #include <boost/static_assert.hpp>
 #include "prf.h"
@@ -46,6 +48,44 @@ void KDF(unsigned char K[NOTEENCRYPTION_CIPHER_KEYSIZE],
     }
 }
 
+// Checks the Poly1305 tag of a ciphertext made with the key K the way
+// crypto_aead_chacha20poly1305_ietf_decrypt does, but without decrypting
+// it, so that ciphertexts for other keys are turned away cheaply.
+bool check_authenticator(const unsigned char *ciphertext,
+                         size_t clen,
+                         const unsigned char K[NOTEENCRYPTION_CIPHER_KEYSIZE]
+                        )
+{
+    static const unsigned char pad0[16] = {};
+
+    // The nonce is zero because we never reuse keys
+    unsigned char cipher_nonce[crypto_aead_chacha20poly1305_IETF_NPUBBYTES] = {};
+
+    // The one-time key is the first block of the key stream
+    unsigned char block0[64];
+    crypto_stream_chacha20_ietf(block0, sizeof block0, cipher_nonce, K);
+
+    crypto_onetimeauth_poly1305_state state;
+    crypto_onetimeauth_poly1305_init(&state, block0);
+    sodium_memzero(block0, sizeof block0);
+
+    // There is no additional data, so only the message is padded
+    size_t mlen = clen - NOTEENCRYPTION_AUTH_BYTES;
+    crypto_onetimeauth_poly1305_update(&state, ciphertext, mlen);
+    crypto_onetimeauth_poly1305_update(&state, pad0, (0x10 - mlen) & 0xf);
+
+    unsigned char lengths[16] = {};
+    for (size_t i = 0; i < 8; i++) {
+        lengths[8 + i] = (uint64_t(mlen) >> (8 * i)) & 0xff;
+    }
+    crypto_onetimeauth_poly1305_update(&state, lengths, sizeof lengths);
+
+    unsigned char mac[NOTEENCRYPTION_AUTH_BYTES];
+    crypto_onetimeauth_poly1305_final(&state, mac);
+
+    return crypto_verify_16(mac, ciphertext + mlen) == 0;
+}
+
 namespace libzcash {
 
 template<size_t MLEN>
@@ -135,6 +175,98 @@ typename NoteDecryption<MLEN>::Plaintext NoteDecryption<MLEN>::decrypt
     return plaintext;
 }
 
+template<size_t MLEN>
+std::vector<typename NoteDecryption<MLEN>::BatchMatch> NoteDecryption<MLEN>::decryptBatch
+                                         (const std::vector<NoteDecryption<MLEN>>& keys,
+                                          const std::vector<typename NoteDecryption<MLEN>::BatchItem>& items,
+                                          unsigned int nThreads
+                                         )
+{
+    // Group the items by epk so that each DH secret is only computed once
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&items](size_t a, size_t b) {
+        return items[a].epk < items[b].epk || (items[a].epk == items[b].epk && a < b);
+    });
+    std::vector<size_t> groups;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i == 0 || items[order[i]].epk != items[order[i - 1]].epk) {
+            groups.push_back(i);
+        }
+    }
+    groups.push_back(order.size());
+
+    // A unit of work is one key against one group of items
+    size_t nWork = (groups.size() - 1) * keys.size();
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = std::max<size_t>(1, std::min<size_t>(nThreads, nWork));
+
+    std::vector<std::vector<BatchMatch>> matches(nThreads);
+    auto worker = [&](unsigned int t) {
+        for (size_t w = t; w < nWork; w += nThreads) {
+            size_t g = w / keys.size();
+            size_t k = w % keys.size();
+            const NoteDecryption<MLEN>& key = keys[k];
+            const uint256& epk = items[order[groups[g]]].epk;
+
+            uint256 dhsecret;
+            if (crypto_scalarmult(dhsecret.begin(), key.sk_enc.begin(), epk.begin()) != 0) {
+                // decrypt() would throw for this epk whatever the ciphertext
+                continue;
+            }
+
+            for (size_t i = groups[g]; i < groups[g + 1]; i++) {
+                const BatchItem& item = items[order[i]];
+                if (item.nonce == 0xff) {
+                    continue;
+                }
+
+                unsigned char K[NOTEENCRYPTION_CIPHER_KEYSIZE];
+                KDF(K, dhsecret, epk, key.pk_enc, item.hSig, item.nonce);
+
+                if (!check_authenticator(item.ciphertext.begin(), CLEN, K)) {
+                    continue;
+                }
+
+                unsigned char cipher_nonce[crypto_aead_chacha20poly1305_IETF_NPUBBYTES] = {};
+                BatchMatch match;
+                match.item = order[i];
+                match.key = k;
+                if (crypto_aead_chacha20poly1305_ietf_decrypt(match.plaintext.begin(), NULL,
+                                                         NULL,
+                                                         item.ciphertext.begin(), CLEN,
+                                                         NULL,
+                                                         0,
+                                                         cipher_nonce, K) == 0) {
+                    matches[t].push_back(match);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < nThreads; t++) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<BatchMatch> result;
+    for (const auto& m : matches) {
+        result.insert(result.end(), m.begin(), m.end());
+    }
+    std::sort(result.begin(), result.end(), [](const BatchMatch& a, const BatchMatch& b) {
+        return a.item < b.item || (a.item == b.item && a.key < b.key);
+    });
+    return result;
+}
+
 template<size_t MLEN>
 uint256 NoteEncryption<MLEN>::generate_privkey(const uint252 &a_sk)
 {
@@ -7,6 +7,7 @@ https://github.com/zcash/zips/blob/master/protocol/protocol.pdf
 #define ZC_NOTE_ENCRYPTION_H_
 
 #include <boost/array.hpp>
+#include <vector>
 #include "uint256.h"
 #include "uint252.h"
 
@@ -61,6 +62,21 @@ public:
     typedef boost::array<unsigned char, CLEN> Ciphertext;
     typedef boost::array<unsigned char, MLEN> Plaintext;
 
+    // A ciphertext for decryptBatch, with the values decrypt() takes
+    struct BatchItem {
+        Ciphertext ciphertext;
+        uint256 epk;
+        uint256 hSig;
+        unsigned char nonce;
+    };
+
+    // A ciphertext that decryptBatch could decrypt, by their indices
+    struct BatchMatch {
+        size_t item;
+        size_t key;
+        Plaintext plaintext;
+    };
+
     NoteDecryption(uint256 sk_enc);
 
     Plaintext decrypt(const Ciphertext &ciphertext,
@@ -68,6 +84,17 @@ public:
                       const uint256 &hSig,
                       unsigned char nonce
                      ) const;
+
+    // Tries every item with every key and returns the ones that decrypt,
+    // ordered by item. The DH secret is computed once per key for all
+    // items sharing an epk (the ciphertexts of one JoinSplit do), and each
+    // authenticator is checked before anything is decrypted. The work is
+    // split over nThreads threads (0 = one per core).
+    static std::vector<BatchMatch> decryptBatch(
+        const std::vector<NoteDecryption>& keys,
+        const std::vector<BatchItem>& items,
+        unsigned int nThreads = 0
+    );
 };
 
 uint256 random_uint256();
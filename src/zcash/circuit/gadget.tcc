@@ -309,6 +309,37 @@ public:
         return verify_field_elements;
     }
 
+    // Same result as witness_map(), packing the inputs straight into
+    // field elements instead of going through a bit vector
+    static r1cs_primary_input<FieldT> packed_witness_map(
+        const uint256& rt,
+        const uint256& h_sig,
+        const boost::array<uint256, NumInputs>& macs,
+        const boost::array<uint256, NumInputs>& nullifiers,
+        const boost::array<uint256, NumOutputs>& commitments,
+        uint64_t vpub_old,
+        uint64_t vpub_new
+    ) {
+        packed_bit_writer<FieldT> writer(verifying_input_bit_size());
+
+        writer.write_uint256(rt);
+        writer.write_uint256(h_sig);
+
+        for (size_t i = 0; i < NumInputs; i++) {
+            writer.write_uint256(nullifiers[i]);
+            writer.write_uint256(macs[i]);
+        }
+
+        for (size_t i = 0; i < NumOutputs; i++) {
+            writer.write_uint256(commitments[i]);
+        }
+
+        writer.write_uint64(vpub_old);
+        writer.write_uint64(vpub_new);
+
+        return writer.result();
+    }
+
     static size_t verifying_input_bit_size() {
         size_t acc = 0;
 
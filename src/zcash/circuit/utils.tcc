@@ -57,6 +57,56 @@ void insert_uint64(std::vector<bool>& into, uint64_t from) {
     into.insert(into.end(), num.begin(), num.end());
 }
 
+// Packs a stream of bits into field elements of FieldT::capacity() bits
+// each, giving the same result as pack_bit_vector_into_field_element_vector
+// without building the bit vector.
+template<typename FieldT>
+class packed_bit_writer {
+private:
+    std::vector<bigint<FieldT::num_limbs>> chunks;
+    size_t pos;
+
+public:
+    packed_bit_writer(size_t num_bits) : chunks(div_ceil(num_bits, FieldT::capacity())), pos(0) {
+        for (auto& chunk : chunks) {
+            chunk.clear();
+        }
+    }
+
+    // Appends the bits of each byte, most significant first, in the order
+    // of convertBytesVectorToVector
+    void write_bytes(const unsigned char* bytes, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            for (size_t j = 0; j < 8; j++, pos++) {
+                if ((bytes[i] >> (7-j)) & 1) {
+                    size_t chunk = pos / FieldT::capacity();
+                    size_t bit = pos % FieldT::capacity();
+                    chunks[chunk].data[bit / GMP_NUMB_BITS] |= ((mp_limb_t) 1) << (bit % GMP_NUMB_BITS);
+                }
+            }
+        }
+    }
+
+    void write_uint256(const uint256& from) {
+        write_bytes(from.begin(), from.size());
+    }
+
+    // Same bit order as insert_uint64
+    void write_uint64(uint64_t from) {
+        std::vector<unsigned char> bytes = convertIntToVectorLE(from);
+        write_bytes(&bytes[0], bytes.size());
+    }
+
+    std::vector<FieldT> result() const {
+        std::vector<FieldT> elements;
+        elements.reserve(chunks.size());
+        for (const auto& chunk : chunks) {
+            elements.emplace_back(chunk);
+        }
+        return elements;
+    }
+};
+
 template<typename T>
 T swap_endianness_u64(T v) {
     if (v.size() != 64) {
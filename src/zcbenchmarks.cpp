@@ -83,6 +83,16 @@ double benchmark_create_joinsplit()
     return ret;
 }
 
+double benchmark_create_joinsplit_single_threaded()
+{
+    // The baseline for the multi-threaded prover
+    unsigned int nThreads = pzcashParams->getProverThreads();
+    pzcashParams->setProverThreads(1);
+    double ret = benchmark_create_joinsplit();
+    pzcashParams->setProverThreads(nThreads);
+    return ret;
+}
+
 double benchmark_verify_joinsplit(const CPourTx &joinsplit)
 {
     timer_start();
@@ -91,6 +101,15 @@ double benchmark_verify_joinsplit(const CPourTx &joinsplit)
     return timer_stop();
 }
 
+double benchmark_verify_joinsplit_overhead(const CPourTx &joinsplit)
+{
+    uint256 pubKeyHash;
+    ZCJoinSplit::Statement statement = joinsplit.GetStatement(pubKeyHash);
+    timer_start();
+    libzcash::DecodeJoinSplitStatement<ZC_NUM_JS_INPUTS, ZC_NUM_JS_OUTPUTS>(statement);
+    return timer_stop();
+}
+
 double benchmark_solve_equihash()
 {
     CBlock pblock;
@@ -126,3 +145,36 @@ double benchmark_verify_equihash()
     return timer_stop();
 }
 
+double benchmark_verify_equihash_midstate()
+{
+    CChainParams params = Params(CBaseChainParams::MAIN);
+    CBlock genesis = Params(CBaseChainParams::MAIN).GenesisBlock();
+    CBlockHeader genesis_header = genesis.GetBlockHeader();
+    crypto_generichash_blake2b_state eh_state;
+    InitEquihashHeaderState(&genesis_header, params, eh_state);
+    timer_start();
+    CheckEquihashSolution(&genesis_header, params, eh_state);
+    return timer_stop();
+}
+
+double benchmark_verify_equihash_basic()
+{
+    CChainParams params = Params(CBaseChainParams::MAIN);
+    CBlock genesis = Params(CBaseChainParams::MAIN).GenesisBlock();
+    CBlockHeader genesis_header = genesis.GetBlockHeader();
+    unsigned int n = params.EquihashN();
+    unsigned int k = params.EquihashK();
+    timer_start();
+    // The verification path used before the allocation-free verifier
+    crypto_generichash_blake2b_state eh_state;
+    EhInitialiseState(n, k, eh_state);
+    CEquihashInput I{genesis_header};
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+    ss << genesis_header.nNonce;
+    crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
+    bool isValid;
+    EhBasicIsValidSolution(n, k, eh_state, genesis_header.nSolution, isValid);
+    return timer_stop();
+}
+
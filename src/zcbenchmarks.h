@@ -7,8 +7,12 @@
 extern double benchmark_sleep();
 extern double benchmark_parameter_loading();
 extern double benchmark_create_joinsplit();
+extern double benchmark_create_joinsplit_single_threaded();
 extern double benchmark_solve_equihash();
 extern double benchmark_verify_joinsplit(const CPourTx &joinsplit);
+extern double benchmark_verify_joinsplit_overhead(const CPourTx &joinsplit);
 extern double benchmark_verify_equihash();
+extern double benchmark_verify_equihash_midstate();
+extern double benchmark_verify_equihash_basic();
 
 #endif